@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace glint {
+
+class MemoryBudget;
+
+enum class ReadBackend { IoUring, ThreadPool };
+
+struct ReadRequest {
+  std::filesystem::path path;
+  size_t length;
+};
+
+struct BatchReaderOptions {
+  size_t queueDepth = 64;
+  size_t maxInflightBytes = 64 * 1024 * 1024;
+  size_t threadCount = 16;
+  bool allowIoUring = true;
+  MemoryBudget *memory = nullptr;
+};
+
+class BatchReader {
+public:
+  using CompletionCallback =
+      std::function<void(size_t index, std::string &&data, int error)>;
+
+  explicit BatchReader(const BatchReaderOptions &options = {});
+  ~BatchReader();
+
+  BatchReader(const BatchReader &) = delete;
+  BatchReader &operator=(const BatchReader &) = delete;
+
+  ReadBackend getBackend() const { return backend_; }
+  const char *getBackendName() const;
+
+  void readAll(const std::vector<ReadRequest> &requests,
+               const CompletionCallback &callback);
+
+private:
+  class Ring;
+
+  void readWithRing(const std::vector<ReadRequest> &requests,
+                    const CompletionCallback &callback);
+  void readWithThreads(const std::vector<ReadRequest> &requests,
+                       const CompletionCallback &callback);
+
+  BatchReaderOptions options_;
+  ReadBackend backend_;
+  std::unique_ptr<Ring> ring_;
+};
+
+} // namespace glint
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace glint {
+
+class ContentHasher {
+public:
+  explicit ContentHasher(uint64_t seed = 0);
+
+  void update(std::string_view data);
+  uint64_t digest() const;
+
+  static uint64_t hash(std::string_view data, uint64_t seed = 0);
+
+private:
+  void consumeStripe(const unsigned char *stripe);
+
+  uint64_t seed_;
+  uint64_t lanes_[4];
+  unsigned char buffer_[32];
+  size_t buffered_;
+  uint64_t totalLength_;
+};
+
+} // namespace glint
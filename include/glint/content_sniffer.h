@@ -0,0 +1,52 @@
+#pragma once
+
+#include "glint/database.h"
+#include "glint/file_info.h"
+#include <filesystem>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace glint {
+
+enum class ContentType { Text, Binary, Unreadable };
+
+class ContentSniffer {
+public:
+  static constexpr size_t SNIFF_SIZE = 8192;
+
+  static ContentType classify(std::string_view block, bool complete);
+  static ContentType classifyFile(const std::filesystem::path &filePath);
+
+  static bool containsNul(std::string_view data);
+  static bool isValidUtf8(std::string_view data, bool allowTruncatedTail);
+};
+
+struct ContentClassStats {
+  size_t hits = 0;
+  size_t sniffed = 0;
+  size_t binary = 0;
+};
+
+class ContentClassCache {
+public:
+  static constexpr size_t FLUSH_THRESHOLD = 1000;
+
+  explicit ContentClassCache(Database &db);
+  ~ContentClassCache();
+
+  ContentClassCache(const ContentClassCache &) = delete;
+  ContentClassCache &operator=(const ContentClassCache &) = delete;
+
+  bool isText(const FileInfo &file);
+  void flush();
+
+  const ContentClassStats &getStats() const { return stats_; }
+
+private:
+  Database &db_;
+  std::vector<std::pair<FileIdentity, bool>> pending_;
+  ContentClassStats stats_;
+};
+
+} // namespace glint
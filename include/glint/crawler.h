@@ -8,14 +8,22 @@
 
 namespace glint {
 
+class MemoryBudget;
+
 class DirectoryCrawler {
 public:
   using ProgressCallback = std::function<void(const FileInfo &)>;
+  using FileFilter = std::function<bool(const FileInfo &)>;
+  using BatchCallback = std::function<void(std::vector<FileInfo> &batch)>;
 
   explicit DirectoryCrawler(const std::filesystem::path &rootPath);
 
   void setFileExtensions(const std::set<std::string> &extensions);
   void setProgressCallback(ProgressCallback callback);
+  void setFileFilter(FileFilter filter);
+  void setBatchCallback(BatchCallback callback, MemoryBudget &memory);
+  void setResumeAfter(const std::filesystem::path &frontier);
+  void setCancelled(std::function<bool()> cancelled);
 
   std::vector<FileInfo> crawl();
 
@@ -23,10 +31,19 @@ private:
   bool shouldProcessFile(const std::filesystem::path &path) const;
   void crawlRecursive(const std::filesystem::path &dir,
                       std::vector<FileInfo> &results);
+  void flushBatch(std::vector<FileInfo> &results);
+  bool isBeforeFrontier(const std::filesystem::path &path,
+                        bool directory) const;
 
   std::filesystem::path rootPath_;
   std::set<std::string> allowedExtensions_;
   ProgressCallback progressCallback_;
+  FileFilter fileFilter_;
+  BatchCallback batchCallback_;
+  std::function<bool()> cancelled_;
+  std::filesystem::path resumeAfter_;
+  MemoryBudget *memory_;
+  size_t batchBytes_;
   size_t filesProcessed_;
 };
 
@@ -1,6 +1,13 @@
 #pragma once
 
 #include "file_info.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -8,9 +15,120 @@ struct sqlite3;
 
 namespace glint {
 
+class PostingsCache;
+
+struct CheckpointPolicy {
+  int passivePages = 1000;
+  int truncatePages = 16384;
+  int64_t journalSizeLimit = 64 * 1024 * 1024;
+  int busyTimeoutMs = 5000;
+};
+
+struct DatabaseOptions {
+  size_t readerCount = 4; // at least 1
+  size_t connectionCacheBytes = 40 * 1024 * 1024;
+  CheckpointPolicy checkpoint;
+  // Dropped entries for postings this connection removes or moves.
+  PostingsCache *postingsCache = nullptr;
+};
+
+struct CheckpointStats {
+  size_t passive = 0;
+  size_t truncate = 0;
+  size_t busy = 0;
+  int lastWalPages = 0;
+};
+
+struct PageCacheStats {
+  int64_t hits = 0;
+  int64_t misses = 0;
+};
+
+struct MaintenanceOptions {
+  int pagesPerStep = 256;
+  std::uintmax_t ioBytesPerSecond = 16 * 1024 * 1024;
+  double minFreeRatio = 0.05;
+  std::function<bool()> cancelled;
+};
+
+struct StorageStats {
+  int64_t pageSize = 0;
+  int64_t pageCount = 0;
+  int64_t freePages = 0;
+  bool incrementalVacuum = false;
+  std::optional<double> fragmentation;
+
+  double freeRatio() const {
+    return pageCount > 0 ? static_cast<double>(freePages) / pageCount : 0.0;
+  }
+};
+
+struct MaintenanceStats {
+  int64_t pagesReclaimed = 0;
+  size_t steps = 0;
+  std::chrono::milliseconds throttled{0};
+  std::chrono::milliseconds elapsed{0};
+};
+
+struct DocumentLocation {
+  uint64_t blockOffset = 0;
+  uint32_t docOffset = 0;
+  uint32_t docLength = 0;
+};
+
+struct FileRecord {
+  int id = -1;
+  std::uintmax_t size = 0;
+  int64_t modifiedTime = 0;
+  std::optional<uint64_t> contentHash;
+};
+
+struct CrawlCheckpoint {
+  std::string root;
+  std::string frontier;
+  std::string pending;
+  size_t files = 0;
+};
+
+struct MergeStats {
+  size_t filesAdded = 0;
+  size_t filesReplaced = 0;
+  size_t filesSkipped = 0;
+  size_t postingsMerged = 0;
+  std::vector<std::pair<int, int>> documents;
+};
+
+struct ScoreBlock {
+  int lastFileId = 0;
+  int maxFrequency = 0;
+};
+
 class Database {
+  struct Connection;
+
 public:
-  explicit Database(const std::string &dbPath);
+  using PostingsSource = std::function<bool(
+      std::string &token, std::vector<std::pair<int, int>> &postings)>;
+
+  class ReadTransaction {
+  public:
+    explicit ReadTransaction(const Database &db);
+    ~ReadTransaction();
+
+    ReadTransaction(const ReadTransaction &) = delete;
+    ReadTransaction &operator=(const ReadTransaction &) = delete;
+
+  private:
+    const Database &db_;
+    Connection *conn_;
+  };
+
+  static constexpr int SCHEMA_VERSION = 10;
+  static constexpr int SCORE_BLOCK_SIZE = 128;
+  static constexpr int TRIGRAM_COUNT_LIMIT = 65536;
+
+  explicit Database(const std::string &dbPath,
+                    const DatabaseOptions &options = {});
   ~Database();
 
   Database(const Database &) = delete;
@@ -23,6 +141,8 @@ public:
   void insertToken(const std::string &token, int fileId, int frequency);
   void
   insertTokens(const std::vector<std::tuple<std::string, int, int>> &tokens);
+  size_t bulkLoadPostings(const PostingsSource &source);
+  MergeStats mergeFrom(const std::string &sourcePath);
 
   size_t getFileCount() const;
   size_t getTokenCount() const;
@@ -30,17 +150,119 @@ public:
   std::string getFilePath(int fileId) const;
   std::vector<std::pair<int, int>> searchToken(const std::string &token) const;
 
+  std::optional<int64_t> getTokenId(const std::string &token) const;
+  std::vector<std::string> getTokensWithPrefix(const std::string &prefix,
+                                               size_t limit) const;
+  std::vector<std::pair<int, int>>
+  readPostings(int64_t tokenId, int firstFileId, int lastFileId) const;
+  std::vector<ScoreBlock> getScoreBlocks(int64_t tokenId) const;
+  bool hasStaleScoreBounds() const;
+  std::vector<std::pair<std::string, size_t>>
+  getFrequentTokens(size_t limit) const;
+  size_t refreshScoreBounds();
+
   bool isFileModified(const std::string &path,
                       std::filesystem::file_time_type modTime) const;
   void deleteFileTokens(int fileId);
-  void optimizeDatabase();
+  void putContentTrigrams(const std::vector<uint64_t> &rows,
+                          const std::vector<int> &fileIds);
+  std::vector<int> getContentTrigramFiles(uint32_t trigram) const;
+  std::vector<int> getTrigramCoveredFiles() const;
+  std::vector<int> getFilesWithoutTrigrams() const;
+  std::vector<int> getIndexedFiles() const;
+  void markStreamed(int fileId);
+  bool isStreamed(int fileId) const;
+  MaintenanceStats optimizeDatabase(const MaintenanceOptions &options = {});
+  void vacuum();
   bool hasFileTokens(int fileId) const;
 
+  void putDocumentLocations(
+      const std::vector<std::pair<int, DocumentLocation>> &locations,
+      bool replaceAll = false);
+  std::optional<DocumentLocation> getDocumentLocation(int fileId) const;
+  std::vector<std::pair<int, DocumentLocation>> getDocumentLocations() const;
+  void deleteDocument(int fileId);
+
+  std::optional<FileRecord> getFileRecord(const std::string &path) const;
+  void setContentHash(int fileId, uint64_t contentHash);
+  int findContentOwner(uint64_t contentHash, int excludeFileId) const;
+  void releaseFileContent(int fileId);
+  void deleteFile(int fileId);
+  size_t renamePaths(const std::string &from, const std::string &to);
+  std::vector<std::pair<int, std::string>>
+  getFilesWithSameContent(int fileId, const std::string &extension = {}) const;
+  std::vector<int> getDocumentsUnder(const std::string &prefix) const;
+  size_t countPathsWithContent(const std::vector<int> &fileIds,
+                               const std::string &prefix) const;
+  std::vector<int>
+  getDocumentsWithExtension(const std::string &extension) const;
+  std::vector<std::string> findPaths(const std::string &substring,
+                                     size_t limit = 0) const;
+
+  std::optional<bool> getContentClass(const FileIdentity &identity) const;
+  void putContentClasses(
+      const std::vector<std::pair<FileIdentity, bool>> &classes);
+
+  std::optional<CrawlCheckpoint>
+  getCrawlCheckpoint(const std::string &root) const;
+  void putCrawlCheckpoint(const CrawlCheckpoint &checkpoint);
+  void deleteCrawlCheckpoint(const std::string &root);
+
+  int getSchemaVersion() const;
+  std::uintmax_t getDatabaseSize() const;
+  StorageStats getStorageStats(bool measureFragmentation = false) const;
+  size_t getCacheMemory() const;
+  PageCacheStats getPageCacheStats() const;
+
+  void checkpoint();
+  CheckpointStats getCheckpointStats() const;
+
 private:
+  class ReaderLease;
+
   void executeSQL(const char *sql);
+  std::string cacheSizePragma() const;
+  void migrateFromV1();
+  void migrateFromV2();
+  void migrateFromV3();
+  void migrateFromV4();
+  void migrateFromV5();
+  void migrateFromV6();
+  void migrateFromV7();
+  void migrateFromV8();
+  void migrateFromV9();
+  int upsertFile(const FileInfo &file);
+  void releaseContent(int fileId);
+  void collectReleasedTokens(int fileId);
+  void invalidateReleasedTokens();
+  void insertPathTrigrams(int fileId, const std::string &path);
+  void
+  insertTrigramRows(const std::vector<std::pair<uint32_t, int>> &trigrams);
+  bool tableExists(Connection &conn, const char *name) const;
+  int64_t queryPragma(Connection &conn, const char *sql) const;
+  bool hasFileTokens(Connection &conn, int fileId) const;
+  Connection *acquireReader() const;
+  void releaseReader(Connection *conn) const;
+  static int walHook(void *context, sqlite3 *db, const char *dbName,
+                     int pages);
+
+  static thread_local const Database *activeReadOwner_;
+  static thread_local Connection *activeReadConnection_;
 
   std::string dbPath_;
+  DatabaseOptions options_;
+  std::unique_ptr<Connection> writer_;
   sqlite3 *db_;
+
+  mutable std::vector<std::unique_ptr<Connection>> readers_;
+  mutable std::vector<Connection *> idleReaders_;
+  mutable std::mutex poolMutex_;
+  mutable std::condition_variable poolAvailable_;
+
+  mutable std::mutex statsMutex_;
+  CheckpointStats checkpointStats_;
+
+  std::vector<std::string> releasedTokens_;
 };
 
 } // namespace glint
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "glint/database.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace glint {
+
+struct DocumentStoreStats {
+  std::uintmax_t fileBytes = 0;
+  std::uintmax_t rawBytes = 0;
+  std::uintmax_t liveBytes = 0;
+  size_t documents = 0;
+
+  double deadRatio() const {
+    return rawBytes > 0 ? 1.0 - static_cast<double>(liveBytes) / rawBytes
+                        : 0.0;
+  }
+};
+
+// Append-only store of normalized document text in compressed blocks.
+// Re-indexed documents leave their old copy behind; compact() rewrites the
+// file with only the live ones. Every open store holds a shared lock on
+// <path>.lock, so compaction only runs while no other process uses it.
+class DocumentStore {
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+  static constexpr double COMPACT_DEAD_RATIO = 0.25;
+
+  static std::filesystem::path pathFor(const std::string &dbPath);
+  static std::string normalize(std::string_view text);
+
+  DocumentStore(Database &db, const std::filesystem::path &path,
+                size_t blockSize = DEFAULT_BLOCK_SIZE);
+  ~DocumentStore();
+
+  DocumentStore(const DocumentStore &) = delete;
+  DocumentStore &operator=(const DocumentStore &) = delete;
+
+  void add(int fileId, std::string_view text);
+  void flush();
+
+  std::string read(int fileId) const;
+
+  DocumentStoreStats getStats() const;
+  std::optional<std::uintmax_t> compact();
+
+  std::uintmax_t getStoredBytes() const { return storedBytes_; }
+  std::uintmax_t getRawBytes() const { return rawBytes_; }
+
+private:
+  struct Mapping;
+
+  std::shared_ptr<const Mapping> mappingFor(std::uint64_t end) const;
+  std::string decode(std::uint64_t blockOffset, size_t length) const;
+
+  Database &db_;
+  std::filesystem::path path_;
+  size_t blockSize_;
+
+  std::ofstream out_;
+  std::string pending_;
+  std::vector<std::pair<int, DocumentLocation>> pendingLocations_;
+  std::uintmax_t storedBytes_;
+  std::uintmax_t rawBytes_;
+
+  mutable std::mutex mappingMutex_;
+  mutable std::shared_ptr<const Mapping> mapping_;
+
+  int lockFd_;
+};
+
+} // namespace glint
@@ -1,23 +1,57 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 namespace glint {
 
+struct FileIdentity {
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  std::int64_t modifiedTime = 0;
+
+  bool isKnown() const { return inode != 0; }
+};
+
 struct FileInfo {
   std::filesystem::path path;
   std::uintmax_t size;
   std::filesystem::file_time_type lastModified;
   std::string extension;
+  FileIdentity identity;
 
   FileInfo(const std::filesystem::path &p)
       : path(p), size(0), extension(p.extension().string()) {
     if (std::filesystem::exists(p) && std::filesystem::is_regular_file(p)) {
       size = std::filesystem::file_size(p);
       lastModified = std::filesystem::last_write_time(p);
+      identity.modifiedTime = lastModified.time_since_epoch().count();
+#ifndef _WIN32
+      struct stat st;
+      if (::stat(p.c_str(), &st) == 0) {
+        identity.device = static_cast<std::uint64_t>(st.st_dev);
+        identity.inode = static_cast<std::uint64_t>(st.st_ino);
+      }
+#endif
     }
   }
 };
 
+// Absolute, with "." and ".." and symlinks resolved as far as the path
+// exists. Indexed paths are stored this way, so lookups must match it.
+inline std::filesystem::path canonicalPath(const std::filesystem::path &p) {
+  std::error_code ec;
+  auto absolute = std::filesystem::absolute(p, ec);
+  if (ec) {
+    return p;
+  }
+  auto canonical = std::filesystem::weakly_canonical(absolute, ec);
+  return ec ? absolute.lexically_normal() : canonical;
+}
+
 } // namespace glint
@@ -1,22 +1,117 @@
 #pragma once
 
 #include "glint/database.h"
-#include <map>
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 
 namespace glint {
 
+class DocumentStore;
+class MemoryBudget;
+class PostingsCache;
+
+using TokenCounts = std::vector<std::pair<std::string, int>>;
+
+enum class BuildMode { Direct, Spimi };
+
+struct IndexBuildOptions {
+  static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+  BuildMode mode = BuildMode::Direct;
+  size_t memoryBudget = 0;
+  std::filesystem::path spillDirectory;
+  bool contentTrigrams = false;
+  DocumentStore *documentStore = nullptr;
+  MemoryBudget *memory = nullptr;
+  PostingsCache *postingsCache = nullptr;
+};
+
+// Term frequencies of one document too large to count in memory. Counts
+// spill to sorted runs once they pass the budget and are summed again when
+// the terms are read back, so memory stays bounded by the budget.
+class TermCounter {
+public:
+  explicit TermCounter(size_t memoryBudget,
+                       std::filesystem::path spillDirectory = {});
+  ~TermCounter();
+
+  TermCounter(const TermCounter &) = delete;
+  TermCounter &operator=(const TermCounter &) = delete;
+
+  void add(std::string &&token);
+  void forEach(const std::function<void(const std::string &, int)> &sink);
+
+  size_t getTokenCount() const { return tokens_; }
+
+private:
+  void spill();
+
+  size_t memoryBudget_;
+  std::filesystem::path spillDirectory_;
+  std::unordered_map<std::string, int> counts_;
+  size_t memoryUsed_;
+  size_t tokens_;
+  std::vector<std::filesystem::path> runs_;
+};
+
+struct IndexBuildStats {
+  size_t filesIndexed = 0;
+  size_t postingsWritten = 0;
+  size_t runsSpilled = 0;
+  std::uintmax_t bytesSpilled = 0;
+  size_t peakMemory = 0;
+  size_t trigramsWritten = 0;
+  std::chrono::nanoseconds buildTime{0};
+};
+
 class IndexBuilder {
 public:
-  explicit IndexBuilder(Database &db);
+  explicit IndexBuilder(Database &db, const IndexBuildOptions &options = {});
+  ~IndexBuilder();
+
+  IndexBuilder(const IndexBuilder &) = delete;
+  IndexBuilder &operator=(const IndexBuilder &) = delete;
 
   void indexFile(const std::string &filePath,
-                 const std::vector<std::string> &tokens);
+                 const std::vector<std::string> &tokens,
+                 std::string_view text = {}, bool completeText = true);
+  void indexTermCounts(const std::string &filePath, TermCounter &counts,
+                       std::string_view text = {});
+  void finish();
+
+  const IndexBuildStats &getStats() const { return stats_; }
 
 private:
+  using Postings = std::vector<std::pair<int, int>>;
+
+  void indexDocument(const std::string &filePath,
+                     const TokenCounts &tokenFrequency, std::string_view text,
+                     bool completeText);
+  void indexDirect(int fileId, const TokenCounts &frequencies);
+  void invert(int fileId, const TokenCounts &frequencies);
+  void releaseDictionary();
+  void addTrigrams(int fileId, std::string_view text);
+  void flushTrigrams();
+  void spillRun();
+  void mergeRuns();
+  void removeRuns();
+
   Database &db_;
+  IndexBuildOptions options_;
+  IndexBuildStats stats_;
+
+  std::unordered_map<std::string, Postings> dictionary_;
+  size_t memoryUsed_;
+  std::vector<std::filesystem::path> runs_;
+
+  std::vector<uint64_t> trigramRows_;
+  std::vector<int> trigramFiles_;
 };
 
 } // namespace glint
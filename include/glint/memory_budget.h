@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace glint {
+
+enum class MemoryComponent { SqliteCache, Crawler, Reader, Index };
+
+class MemoryBudget {
+public:
+  static constexpr size_t DEFAULT_LIMIT = 256 * 1024 * 1024;
+  static constexpr size_t COMPONENT_COUNT = 4;
+
+  explicit MemoryBudget(size_t limit = DEFAULT_LIMIT);
+
+  MemoryBudget(const MemoryBudget &) = delete;
+  MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+  size_t getLimit() const { return limit_; }
+  size_t share(MemoryComponent component) const;
+
+  void charge(MemoryComponent component, size_t bytes);
+  void release(MemoryComponent component, size_t bytes);
+  void set(MemoryComponent component, size_t bytes);
+
+  size_t used(MemoryComponent component) const;
+  size_t peak(MemoryComponent component) const;
+  bool exceeded(MemoryComponent component) const {
+    return used(component) >= share(component);
+  }
+
+  static const char *name(MemoryComponent component);
+
+private:
+  struct Account {
+    std::atomic<size_t> used{0};
+    std::atomic<size_t> peak{0};
+  };
+
+  void notePeak(Account &account, size_t value);
+
+  size_t limit_;
+  std::array<Account, COMPONENT_COUNT> accounts_;
+};
+
+} // namespace glint
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+namespace glint {
+
+constexpr size_t MAX_MEGABYTES =
+    std::numeric_limits<size_t>::max() / (1024 * 1024);
+
+// A whole decimal number within [minValue, maxValue]. Signs, trailing text
+// and overflow are rejected rather than wrapped or ignored.
+inline std::optional<size_t>
+parseNumber(std::string_view text, size_t minValue = 0,
+            size_t maxValue = std::numeric_limits<size_t>::max()) {
+  size_t value = 0;
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end != text.data() + text.size() ||
+      value < minValue || value > maxValue) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// A finite, non-negative decimal such as 0.5.
+inline std::optional<double> parseDecimal(std::string_view text) {
+  double value = 0;
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end != text.data() + text.size() ||
+      !std::isfinite(value) || value < 0) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+} // namespace glint
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace glint {
+
+struct PostingsCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t admitted = 0;
+  size_t rejected = 0;
+  size_t evicted = 0;
+  size_t invalidated = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+
+  double hitRate() const {
+    return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses)
+                             : 0.0;
+  }
+};
+
+// Decoded postings of hot terms, shared by query threads. Admission follows
+// TinyLFU: once the budget is full a term only displaces resident terms
+// that were requested less often, so scans of rare long lists cannot flush
+// the hot set.
+class PostingsCache {
+public:
+  using Postings = std::vector<std::pair<int, int>>;
+  using Entry = std::shared_ptr<const Postings>;
+
+  static constexpr size_t DEFAULT_CAPACITY = 32 * 1024 * 1024;
+  static constexpr size_t SKETCH_WIDTH = 8192;
+  static constexpr size_t SKETCH_DEPTH = 4;
+
+  explicit PostingsCache(size_t capacity = DEFAULT_CAPACITY);
+
+  PostingsCache(const PostingsCache &) = delete;
+  PostingsCache &operator=(const PostingsCache &) = delete;
+
+  uint64_t ticket() const;
+  Entry find(const std::string &token);
+  bool wanted(const std::string &token) const;
+  Entry insert(const std::string &token, Postings postings, uint64_t ticket);
+  void invalidate(const std::string &token);
+  void clear();
+
+  size_t getCapacity() const { return capacity_; }
+  PostingsCacheStats getStats() const;
+
+private:
+  struct Slot {
+    Entry postings;
+    size_t bytes = 0;
+    std::list<std::string>::iterator recency;
+  };
+
+  void record(size_t hash);
+  unsigned estimate(size_t hash) const;
+
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Slot> slots_;
+  std::list<std::string> recency_;
+  std::array<std::vector<uint8_t>, SKETCH_DEPTH> sketch_;
+  size_t samples_ = 0;
+  size_t bytes_ = 0;
+  uint64_t epoch_ = 0;
+  PostingsCacheStats stats_;
+};
+
+} // namespace glint
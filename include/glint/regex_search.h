@@ -0,0 +1,47 @@
+#pragma once
+
+#include "glint/database.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace glint {
+
+struct RegexMatch {
+  std::string filePath;
+  std::vector<std::pair<size_t, std::string>> lines;
+};
+
+struct RegexSearchStats {
+  size_t candidates = 0;
+  size_t unindexed = 0;
+  size_t filesRead = 0;
+  size_t linesSkipped = 0;
+  bool truncated = false;
+  std::string plan;
+};
+
+struct RegexSearchOptions {
+  size_t limit = 0;
+  bool ignoreCase = false;
+  RegexSearchStats *stats = nullptr;
+};
+
+// Narrows candidates with the content trigram index, then verifies each one
+// line by line. Files without trigram coverage are always verified, so the
+// index never hides a match. Lines longer than MAX_LINE_LENGTH are not
+// searched and are counted in linesSkipped instead.
+class RegexSearch {
+public:
+  static constexpr size_t MAX_LINE_LENGTH = 16 * 1024;
+
+  explicit RegexSearch(const Database &db);
+
+  std::vector<RegexMatch> search(const std::string &pattern,
+                                 const RegexSearchOptions &options = {}) const;
+
+private:
+  const Database &db_;
+};
+
+} // namespace glint
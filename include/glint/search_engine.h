@@ -1,7 +1,12 @@
 #pragma once
 
 #include "glint/database.h"
+#include "glint/postings_cache.h"
+#include <chrono>
+#include <functional>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace glint {
@@ -10,19 +15,116 @@ struct SearchResult {
   std::string filePath;
   int score;
   std::string preview;
+  int fileId;
 
-  SearchResult(const std::string &path, int s, const std::string& prev = "") : filePath(path), score(s), preview(prev) {}
+  SearchResult(const std::string &path, int s, const std::string& prev = "", int id = -1) : filePath(path), score(s), preview(prev), fileId(id) {}
 };
 
+struct SearchStats {
+  bool pruned = false;
+  bool refined = false;
+  size_t documentsScored = 0;
+  size_t blocksSkipped = 0;
+  size_t postingsRead = 0;
+  size_t cacheHits = 0;
+  size_t cacheMisses = 0;
+  std::chrono::nanoseconds scoringTime{0};
+  std::vector<std::string> plan;
+};
+
+struct SearchCursor {
+  int score = 0;
+  int fileId = -1;
+  std::string filePath;
+};
+
+struct SearchPage {
+  std::vector<SearchResult> results;
+  size_t totalHits = 0;
+  bool totalIsEstimate = false;
+  std::optional<SearchCursor> next;
+};
+
+class SearchSession {
+public:
+  static constexpr size_t MAX_CACHED_POSTINGS = 4 * 1024 * 1024;
+
+  void clear();
+
+private:
+  friend class SearchEngine;
+
+  std::string prefix_;
+  std::vector<std::string> expansions_;
+  bool complete_ = false;
+  std::unordered_map<std::string, std::vector<std::pair<int, int>>> postings_;
+  size_t cachedPostings_ = 0;
+};
+
+struct SearchOptions {
+  std::string fileTypeFilter;
+  std::string directory;
+  size_t limit = 0;
+  size_t offset = 0;
+  std::optional<SearchCursor> after;
+  bool pruning = true;
+  bool previews = true;
+  bool prefixLastTerm = false;
+  SearchSession *session = nullptr;
+  std::function<bool()> cancelled;
+  SearchStats *stats = nullptr;
+};
+
+class DocumentStore;
+
 class SearchEngine {
 public:
-  explicit SearchEngine(Database &db);
+  static constexpr size_t MAX_PREFIX_EXPANSIONS = 1024;
+
+  explicit SearchEngine(Database &db,
+                        const DocumentStore *documents = nullptr,
+                        PostingsCache *postingsCache = nullptr);
 
   std::vector<SearchResult> search(const std::string &query) const;
   std::vector<SearchResult> search(const std::string &query, const std::string &fileTypeFilter) const;
+  std::vector<SearchResult> search(const std::string &query,
+                                   const SearchOptions &options) const;
+  SearchPage searchPage(const std::string &query,
+                        const SearchOptions &options) const;
+
+  std::string preview(const SearchResult &result, const std::string &query,
+                      bool prefixLastTerm = false) const;
 
 private:
+  struct ParsedQuery;
+  struct Candidate;
+  struct PlannedTerm;
+  using Postings = std::vector<std::pair<int, int>>;
+
+  static bool isCancelled(const SearchOptions &options);
+
+  ParsedQuery parse(const std::string &query, bool prefixLastTerm) const;
+  std::string loadText(int fileId, const std::string &filePath) const;
+  bool accept(int fileId, const ParsedQuery &query,
+              const std::string &fileTypeFilter, Candidate &candidate) const;
+  PostingsCache::Entry cachedPostings(const std::string &token,
+                                      const ParsedQuery &query,
+                                      bool load) const;
+  std::vector<std::pair<int, int>>
+  postingsFor(const std::string &token, const ParsedQuery &query) const;
+  PlannedTerm planTerm(const std::string &token) const;
+  Postings postingsAmong(const PlannedTerm &term, const Postings &candidates,
+                         const ParsedQuery &query, std::string &access) const;
+  std::vector<Candidate> scoreExhaustive(const ParsedQuery &query,
+                                         const SearchOptions &options,
+                                         size_t &matched) const;
+  std::vector<Candidate> scoreTopK(const ParsedQuery &query,
+                                   const SearchOptions &options, size_t depth,
+                                   size_t &matched) const;
+
   Database &db_;
+  const DocumentStore *documents_;
+  PostingsCache *postingsCache_;
 };
 
 } // namespace glint
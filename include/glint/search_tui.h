@@ -0,0 +1,58 @@
+#pragma once
+
+#include "glint/search_engine.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace glint {
+
+struct TuiOptions {
+  std::chrono::milliseconds debounce{30};
+  std::chrono::milliseconds latencyBudget{100};
+  size_t maxResults = 200;
+};
+
+class SearchTui {
+public:
+  explicit SearchTui(const SearchEngine &engine,
+                     const TuiOptions &options = {});
+  ~SearchTui();
+
+  SearchTui(const SearchTui &) = delete;
+  SearchTui &operator=(const SearchTui &) = delete;
+
+  std::string run();
+
+private:
+  void evaluate();
+  void submit(const std::string &query);
+  void showError(uint64_t generation, const std::string &message);
+  void render(const std::string &query, size_t selected, size_t &scroll);
+
+  const SearchEngine &engine_;
+  TuiOptions options_;
+  SearchSession session_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread worker_;
+  bool stopping_ = false;
+  bool dirty_ = true;
+  std::string pending_;
+  std::atomic<uint64_t> requested_{0};
+
+  uint64_t shown_ = 0;
+  std::vector<SearchResult> results_;
+  std::vector<std::string> previews_;
+  SearchStats stats_;
+  std::string error_;
+  std::chrono::steady_clock::time_point submittedAt_;
+  std::chrono::milliseconds elapsed_{0};
+};
+
+} // namespace glint
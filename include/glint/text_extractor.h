@@ -1,19 +1,34 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
 
 
 namespace glint {
 
+enum class OversizePolicy { Skip, Truncate, Stream };
+
+struct ExtractionPolicy {
+  size_t maxFileSize = 10 * 1024 * 1024;
+  OversizePolicy oversize = OversizePolicy::Skip;
+  size_t chunkSize = 1024 * 1024;
+  bool sniffContent = true;
+};
+
 class TextExtractor {
 public:
   static constexpr size_t MAX_FILE_SIZE = 10 * 1024 * 1024;
 
-  static std::string extractText(const std::filesystem::path &filePath);
+  using ChunkCallback = std::function<bool(std::string_view chunk)>;
 
-private:
-  static bool isTextFile(const std::filesystem::path &filePath);
+  static std::string extractText(const std::filesystem::path &filePath);
+  static std::string extractText(const std::filesystem::path &filePath,
+                                 const ExtractionPolicy &policy);
+  static bool extractChunks(const std::filesystem::path &filePath,
+                            const ExtractionPolicy &policy,
+                            const ChunkCallback &callback);
 };
 
 } // namespace glint
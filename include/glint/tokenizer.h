@@ -1,19 +1,66 @@
 #pragma once
 
+#include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace glint {
 
-class Tokenizer {
+enum class TextKind { Prose, Code, Log };
+
+struct ProsePolicy;
+struct CodePolicy;
+struct LogPolicy;
+
+template <typename Policy = ProsePolicy> class Tokenizer {
 public:
   static constexpr size_t MIN_WORD_LENGTH = 3;
+  static constexpr size_t MAX_CARRY_LENGTH = 64 * 1024;
+
+  using TokenSink = std::function<void(std::string &&token)>;
+
+  class Stream {
+  public:
+    explicit Stream(TokenSink sink);
+
+    void feed(std::string_view chunk);
+    void finish();
 
-  static std::vector<std::string> tokenize(const std::string &text);
+  private:
+    void emit(std::string_view word);
 
-private:
-  static std::string normalize(const std::string &word);
-  static bool isValidToken(const std::string &token);
+    TokenSink sink_;
+    std::string carry_;
+  };
+
+  static std::vector<std::string> tokenize(std::string_view text);
 };
 
+extern template class Tokenizer<ProsePolicy>;
+extern template class Tokenizer<CodePolicy>;
+extern template class Tokenizer<LogPolicy>;
+
+TextKind textKindFor(const std::filesystem::path &path);
+
+template <typename Visitor>
+decltype(auto) withTokenizer(TextKind kind, Visitor &&visitor) {
+  switch (kind) {
+  case TextKind::Code:
+    return visitor(Tokenizer<CodePolicy>{});
+  case TextKind::Log:
+    return visitor(Tokenizer<LogPolicy>{});
+  default:
+    return visitor(Tokenizer<ProsePolicy>{});
+  }
+}
+
+inline std::vector<std::string> tokenize(TextKind kind,
+                                         std::string_view text) {
+  return withTokenizer(kind, [&](auto tokenizer) {
+    return decltype(tokenizer)::tokenize(text);
+  });
+}
+
 } // namespace glint
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace glint {
+
+std::vector<uint32_t> extractTrigrams(std::string_view text);
+
+struct TrigramQuery {
+  enum class Op { All, None, And, Or };
+
+  Op op = Op::All;
+  std::vector<uint32_t> trigrams;
+  std::vector<TrigramQuery> subs;
+
+  static TrigramQuery all() { return {}; }
+  static TrigramQuery none() { return {Op::None, {}, {}}; }
+  static TrigramQuery fromRegex(std::string_view pattern);
+
+  std::string toString() const;
+};
+
+TrigramQuery allOf(TrigramQuery a, TrigramQuery b);
+TrigramQuery anyOf(TrigramQuery a, TrigramQuery b);
+
+} // namespace glint
@@ -0,0 +1,539 @@
+#include "glint/batch_reader.h"
+#include "glint/memory_budget.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define GLINT_HAVE_IO_URING 1
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace glint {
+
+#ifdef GLINT_HAVE_IO_URING
+
+class BatchReader::Ring {
+public:
+  ~Ring() {
+    if (sqes_) {
+      ::munmap(sqes_, sqesSize_);
+    }
+    if (cqPtr_ && cqPtr_ != sqPtr_) {
+      ::munmap(cqPtr_, cqSize_);
+    }
+    if (sqPtr_) {
+      ::munmap(sqPtr_, sqSize_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  bool init(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return false;
+    }
+
+    // OPENAT and READ arrived in 5.6; FAST_POLL (5.7) is the closest
+    // feature bit that guarantees them.
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+      return false;
+    }
+
+    sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    }
+
+    sqPtr_ = ::mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sqPtr_ == MAP_FAILED) {
+      sqPtr_ = nullptr;
+      return false;
+    }
+
+    if (singleMmap) {
+      cqPtr_ = sqPtr_;
+    } else {
+      cqPtr_ = ::mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cqPtr_ == MAP_FAILED) {
+        cqPtr_ = nullptr;
+        return false;
+      }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    auto *sq = static_cast<char *>(sqPtr_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+
+    auto *cq = static_cast<char *>(cqPtr_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return probe();
+  }
+
+  unsigned capacity() const { return sqEntries_; }
+
+  io_uring_sqe *nextSqe() {
+    unsigned tail = *sqTail_;
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sqEntries_) {
+      return nullptr;
+    }
+
+    unsigned index = tail & sqMask_;
+    sqArray_[index] = index;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted_++;
+    return sqe;
+  }
+
+  int submitAndWait(unsigned waitCount) {
+    int rc = 0;
+    do {
+      rc = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, unsubmitted_,
+                                      waitCount, IORING_ENTER_GETEVENTS,
+                                      nullptr, 0));
+    } while (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+    if (rc >= 0) {
+      unsubmitted_ -= std::min<unsigned>(unsubmitted_, rc);
+    }
+    return rc;
+  }
+
+  bool popCqe(io_uring_cqe &cqe) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      return false;
+    }
+
+    cqe = cqes_[head & cqMask_];
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  bool probe() {
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_NOP;
+    if (submitAndWait(1) < 0) {
+      return false;
+    }
+
+    io_uring_cqe cqe;
+    return popCqe(cqe) && cqe.res == 0;
+  }
+
+  int fd_ = -1;
+  void *sqPtr_ = nullptr;
+  void *cqPtr_ = nullptr;
+  size_t sqSize_ = 0;
+  size_t cqSize_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqesSize_ = 0;
+
+  unsigned *sqHead_ = nullptr;
+  unsigned *sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned *sqArray_ = nullptr;
+  unsigned sqEntries_ = 0;
+
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+
+  unsigned unsubmitted_ = 0;
+};
+
+#else
+
+class BatchReader::Ring {};
+
+#endif
+
+BatchReader::BatchReader(const BatchReaderOptions &options)
+    : options_(options), backend_(ReadBackend::ThreadPool) {
+  options_.queueDepth = std::max<size_t>(options_.queueDepth, 1);
+  options_.threadCount = std::max<size_t>(options_.threadCount, 1);
+
+#ifdef GLINT_HAVE_IO_URING
+  if (options_.allowIoUring) {
+    auto ring = std::make_unique<Ring>();
+    if (ring->init(static_cast<unsigned>(options_.queueDepth))) {
+      ring_ = std::move(ring);
+      backend_ = ReadBackend::IoUring;
+    }
+  }
+#endif
+}
+
+BatchReader::~BatchReader() = default;
+
+const char *BatchReader::getBackendName() const {
+  return backend_ == ReadBackend::IoUring ? "io_uring" : "thread pool";
+}
+
+void BatchReader::readAll(const std::vector<ReadRequest> &requests,
+                          const CompletionCallback &callback) {
+  if (requests.empty()) {
+    return;
+  }
+
+  if (backend_ == ReadBackend::IoUring) {
+    readWithRing(requests, callback);
+  } else {
+    readWithThreads(requests, callback);
+  }
+}
+
+#ifdef GLINT_HAVE_IO_URING
+
+// Each slot submits an OPENAT and, once the fd is known, READs until the
+// buffer is full or the file ends. The fd is then closed synchronously;
+// the operations are not linked because READ needs OPENAT's result.
+void BatchReader::readWithRing(const std::vector<ReadRequest> &requests,
+                               const CompletionCallback &callback) {
+  enum class Stage { Idle, Open, Read };
+
+  struct Slot {
+    Stage stage = Stage::Idle;
+    size_t index = 0;
+    int fd = -1;
+    std::string buffer;
+    size_t filled = 0;
+  };
+
+  std::vector<Slot> slots(ring_->capacity());
+  std::vector<size_t> freeSlots;
+  for (size_t i = slots.size(); i-- > 0;) {
+    freeSlots.push_back(i);
+  }
+
+  size_t next = 0;
+  size_t active = 0;
+  size_t inflightBytes = 0;
+
+  auto queueRead = [&](size_t slotId) {
+    Slot &slot = slots[slotId];
+    io_uring_sqe *sqe = ring_->nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data() + slot.filled);
+    sqe->len = static_cast<uint32_t>(slot.buffer.size() - slot.filled);
+    sqe->off = slot.filled;
+    sqe->user_data = slotId;
+    slot.stage = Stage::Read;
+  };
+
+  auto release = [&](size_t slotId) {
+    Slot &slot = slots[slotId];
+    if (slot.fd >= 0) {
+      ::close(slot.fd);
+      slot.fd = -1;
+    }
+
+    inflightBytes -= slot.buffer.size();
+    if (options_.memory) {
+      options_.memory->release(MemoryComponent::Reader, slot.buffer.size());
+    }
+    slot.buffer.resize(slot.filled);
+    std::string data = std::move(slot.buffer);
+
+    slot = Slot();
+    freeSlots.push_back(slotId);
+    active--;
+    return data;
+  };
+
+  auto complete = [&](size_t slotId, int error) {
+    size_t index = slots[slotId].index;
+    std::string data = release(slotId);
+    callback(index, std::move(data), error);
+  };
+
+  // The kernel may still write into slot buffers, so they must outlive
+  // every queued operation before an exception leaves this frame.
+  auto drain = [&] {
+    io_uring_cqe cqe;
+    while (active > 0 && ring_->submitAndWait(1) >= 0) {
+      while (ring_->popCqe(cqe)) {
+        auto slotId = static_cast<size_t>(cqe.user_data);
+        if (slots[slotId].stage == Stage::Open && cqe.res >= 0) {
+          slots[slotId].fd = cqe.res;
+        }
+        release(slotId);
+      }
+    }
+  };
+
+  try {
+    while (next < requests.size() || active > 0) {
+      while (next < requests.size() && !freeSlots.empty()) {
+        size_t length = requests[next].length;
+        if (active > 0 && inflightBytes + length > options_.maxInflightBytes) {
+          break;
+        }
+
+        size_t slotId = freeSlots.back();
+        freeSlots.pop_back();
+
+        Slot &slot = slots[slotId];
+        slot.stage = Stage::Open;
+        slot.index = next;
+        slot.buffer.resize(length);
+        inflightBytes += length;
+        if (options_.memory) {
+          options_.memory->charge(MemoryComponent::Reader, length);
+        }
+
+        io_uring_sqe *sqe = ring_->nextSqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(requests[next].path.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = slotId;
+
+        active++;
+        next++;
+      }
+
+      if (ring_->submitAndWait(1) < 0) {
+        throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                                 std::strerror(errno));
+      }
+
+      io_uring_cqe cqe;
+      while (ring_->popCqe(cqe)) {
+        auto slotId = static_cast<size_t>(cqe.user_data);
+        Slot &slot = slots[slotId];
+
+        if (cqe.res < 0) {
+          complete(slotId, -cqe.res);
+          continue;
+        }
+
+        if (slot.stage == Stage::Open) {
+          slot.fd = cqe.res;
+          if (slot.buffer.empty()) {
+            complete(slotId, 0);
+          } else {
+            queueRead(slotId);
+          }
+          continue;
+        }
+
+        slot.filled += static_cast<size_t>(cqe.res);
+        if (cqe.res == 0 || slot.filled == slot.buffer.size()) {
+          complete(slotId, 0);
+        } else {
+          queueRead(slotId);
+        }
+      }
+    }
+  } catch (...) {
+    drain();
+    throw;
+  }
+}
+
+#else
+
+void BatchReader::readWithRing(const std::vector<ReadRequest> &requests,
+                               const CompletionCallback &callback) {
+  readWithThreads(requests, callback);
+}
+
+#endif
+
+namespace {
+
+int readFile(const ReadRequest &request, std::string &data) {
+  data.resize(request.length);
+
+#ifndef _WIN32
+  int fd = ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    data.clear();
+    return errno;
+  }
+
+  size_t filled = 0;
+  while (filled < data.size()) {
+    ssize_t got = ::pread(fd, data.data() + filled, data.size() - filled,
+                          static_cast<off_t>(filled));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      int error = got < 0 ? errno : 0;
+      ::close(fd);
+      data.resize(filled);
+      return error;
+    }
+    filled += static_cast<size_t>(got);
+  }
+
+  ::close(fd);
+  return 0;
+#else
+  std::ifstream file(request.path, std::ios::binary);
+  if (!file.is_open()) {
+    data.clear();
+    return ENOENT;
+  }
+
+  file.read(data.data(), static_cast<std::streamsize>(data.size()));
+  data.resize(static_cast<size_t>(file.gcount()));
+  return 0;
+#endif
+}
+
+} // namespace
+
+void BatchReader::readWithThreads(const std::vector<ReadRequest> &requests,
+                                  const CompletionCallback &callback) {
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable budget;
+  std::deque<std::tuple<size_t, std::string, int>> completed;
+  size_t inflightBytes = 0;
+  bool stopping = false;
+  std::atomic<size_t> next{0};
+
+  auto worker = [&] {
+    while (true) {
+      size_t index = next++;
+      if (index >= requests.size()) {
+        break;
+      }
+
+      size_t length = requests[index].length;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        budget.wait(lock, [&] {
+          return stopping || inflightBytes == 0 ||
+                 inflightBytes + length <= options_.maxInflightBytes;
+        });
+        if (stopping) {
+          break;
+        }
+        inflightBytes += length;
+      }
+      if (options_.memory) {
+        options_.memory->charge(MemoryComponent::Reader, length);
+      }
+
+      std::string data;
+      int error = readFile(requests[index], data);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.emplace_back(index, std::move(data), error);
+      }
+      ready.notify_one();
+    }
+  };
+
+  size_t threadCount = std::min(options_.threadCount, requests.size());
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  // Stops the workers after a callback throws. Joinable threads would
+  // terminate the process when destroyed, and a worker waiting for budget
+  // is never woken otherwise. Reads already started finish and are
+  // released with the rest of the budget.
+  auto stop = [&] {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    next = requests.size();
+    budget.notify_all();
+    ready.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    if (options_.memory && inflightBytes > 0) {
+      options_.memory->release(MemoryComponent::Reader, inflightBytes);
+    }
+  };
+
+  try {
+    for (size_t done = 0; done < requests.size(); ++done) {
+      std::tuple<size_t, std::string, int> item;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] { return !completed.empty(); });
+        item = std::move(completed.front());
+        completed.pop_front();
+      }
+
+      auto &[index, data, error] = item;
+      callback(index, std::move(data), error);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        inflightBytes -= requests[index].length;
+      }
+      if (options_.memory) {
+        options_.memory->release(MemoryComponent::Reader,
+                                 requests[index].length);
+      }
+      budget.notify_all();
+    }
+  } catch (...) {
+    stop();
+    throw;
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace glint
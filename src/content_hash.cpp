@@ -0,0 +1,137 @@
+#include "glint/content_hash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace glint {
+
+namespace {
+
+// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md).
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t rotl(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t read64(const unsigned char *p) {
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint64_t round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME2;
+  acc = rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+  acc ^= round(0, lane);
+  return acc * PRIME1 + PRIME4;
+}
+
+} // namespace
+
+ContentHasher::ContentHasher(uint64_t seed)
+    : seed_(seed), buffered_(0), totalLength_(0) {
+  lanes_[0] = seed + PRIME1 + PRIME2;
+  lanes_[1] = seed + PRIME2;
+  lanes_[2] = seed;
+  lanes_[3] = seed - PRIME1;
+}
+
+void ContentHasher::consumeStripe(const unsigned char *stripe) {
+  lanes_[0] = round(lanes_[0], read64(stripe));
+  lanes_[1] = round(lanes_[1], read64(stripe + 8));
+  lanes_[2] = round(lanes_[2], read64(stripe + 16));
+  lanes_[3] = round(lanes_[3], read64(stripe + 24));
+}
+
+void ContentHasher::update(std::string_view data) {
+  const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+  size_t length = data.size();
+  totalLength_ += length;
+
+  if (buffered_ > 0) {
+    size_t take = std::min(length, sizeof(buffer_) - buffered_);
+    std::memcpy(buffer_ + buffered_, p, take);
+    buffered_ += take;
+    p += take;
+    length -= take;
+    if (buffered_ < sizeof(buffer_)) {
+      return;
+    }
+    consumeStripe(buffer_);
+    buffered_ = 0;
+  }
+
+  while (length >= sizeof(buffer_)) {
+    consumeStripe(p);
+    p += sizeof(buffer_);
+    length -= sizeof(buffer_);
+  }
+
+  std::memcpy(buffer_, p, length);
+  buffered_ = length;
+}
+
+uint64_t ContentHasher::digest() const {
+  uint64_t acc;
+  if (totalLength_ >= sizeof(buffer_)) {
+    acc = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) +
+          rotl(lanes_[3], 18);
+    for (uint64_t lane : lanes_) {
+      acc = mergeRound(acc, lane);
+    }
+  } else {
+    acc = seed_ + PRIME5;
+  }
+
+  acc += totalLength_;
+
+  const unsigned char *p = buffer_;
+  size_t remaining = buffered_;
+  while (remaining >= 8) {
+    acc ^= round(0, read64(p));
+    acc = rotl(acc, 27) * PRIME1 + PRIME4;
+    p += 8;
+    remaining -= 8;
+  }
+  if (remaining >= 4) {
+    acc ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+    acc = rotl(acc, 23) * PRIME2 + PRIME3;
+    p += 4;
+    remaining -= 4;
+  }
+  while (remaining > 0) {
+    acc ^= static_cast<uint64_t>(*p) * PRIME5;
+    acc = rotl(acc, 11) * PRIME1;
+    p++;
+    remaining--;
+  }
+
+  acc ^= acc >> 33;
+  acc *= PRIME2;
+  acc ^= acc >> 29;
+  acc *= PRIME3;
+  acc ^= acc >> 32;
+  return acc;
+}
+
+uint64_t ContentHasher::hash(std::string_view data, uint64_t seed) {
+  ContentHasher hasher(seed);
+  hasher.update(data);
+  return hasher.digest();
+}
+
+} // namespace glint
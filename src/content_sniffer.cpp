@@ -0,0 +1,213 @@
+#include "glint/content_sniffer.h"
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GLINT_SNIFF_SSE2 1
+#endif
+
+namespace glint {
+
+namespace {
+
+#ifdef GLINT_SNIFF_SSE2
+int ctz(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+size_t skipAscii(const unsigned char *data, size_t pos, size_t size) {
+#ifdef GLINT_SNIFF_SSE2
+  while (pos + 16 <= size) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+    if (mask != 0) {
+      return pos + ctz(mask);
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < size && data[pos] < 0x80) {
+    pos++;
+  }
+  return pos;
+}
+
+bool inRange(unsigned char c, unsigned char low, unsigned char high) {
+  return c >= low && c <= high;
+}
+
+} // namespace
+
+bool ContentSniffer::containsNul(std::string_view data) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  size_t size = data.size();
+  size_t pos = 0;
+
+#ifdef GLINT_SNIFF_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  while (pos + 64 <= size) {
+    auto *p = reinterpret_cast<const __m128i *>(bytes + pos);
+    __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(p), zero);
+    __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(p + 1), zero);
+    __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(p + 2), zero);
+    __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(p + 3), zero);
+    __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    if (_mm_movemask_epi8(any) != 0) {
+      return true;
+    }
+    pos += 64;
+  }
+  while (pos + 16 <= size) {
+    __m128i bytesVec =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytesVec, zero)) != 0) {
+      return true;
+    }
+    pos += 16;
+  }
+#endif
+
+  for (; pos < size; ++pos) {
+    if (bytes[pos] == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ContentSniffer::isValidUtf8(std::string_view data,
+                                 bool allowTruncatedTail) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  size_t size = data.size();
+  size_t pos = 0;
+
+  while (true) {
+    pos = skipAscii(bytes, pos, size);
+    if (pos >= size) {
+      return true;
+    }
+
+    unsigned char lead = bytes[pos];
+    size_t length = 0;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+
+    if (inRange(lead, 0xC2, 0xDF)) {
+      length = 2;
+    } else if (lead == 0xE0) {
+      length = 3;
+      low = 0xA0;
+    } else if (inRange(lead, 0xE1, 0xEC) || inRange(lead, 0xEE, 0xEF)) {
+      length = 3;
+    } else if (lead == 0xED) {
+      length = 3;
+      high = 0x9F;
+    } else if (lead == 0xF0) {
+      length = 4;
+      low = 0x90;
+    } else if (inRange(lead, 0xF1, 0xF3)) {
+      length = 4;
+    } else if (lead == 0xF4) {
+      length = 4;
+      high = 0x8F;
+    } else {
+      return false;
+    }
+
+    for (size_t i = 1; i < length; ++i) {
+      if (pos + i >= size) {
+        return allowTruncatedTail;
+      }
+      unsigned char c = bytes[pos + i];
+      if (i == 1 ? !inRange(c, low, high) : !inRange(c, 0x80, 0xBF)) {
+        return false;
+      }
+    }
+
+    pos += length;
+  }
+}
+
+ContentType ContentSniffer::classify(std::string_view block, bool complete) {
+  if (containsNul(block)) {
+    return ContentType::Binary;
+  }
+  if (!isValidUtf8(block, !complete)) {
+    return ContentType::Binary;
+  }
+  return ContentType::Text;
+}
+
+ContentType ContentSniffer::classifyFile(const std::filesystem::path &filePath) {
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file.is_open()) {
+    return ContentType::Unreadable;
+  }
+
+  char block[SNIFF_SIZE];
+  file.read(block, sizeof(block));
+  auto got = static_cast<size_t>(file.gcount());
+  bool complete = got < sizeof(block);
+
+  return classify(std::string_view(block, got), complete);
+}
+
+ContentClassCache::ContentClassCache(Database &db) : db_(db) {}
+
+ContentClassCache::~ContentClassCache() {
+  try {
+    flush();
+  } catch (...) {
+  }
+}
+
+bool ContentClassCache::isText(const FileInfo &file) {
+  if (file.identity.isKnown()) {
+    if (auto cached = db_.getContentClass(file.identity)) {
+      stats_.hits++;
+      if (!*cached) {
+        stats_.binary++;
+      }
+      return *cached;
+    }
+  }
+
+  ContentType type = ContentSniffer::classifyFile(file.path);
+  stats_.sniffed++;
+  if (type == ContentType::Unreadable) {
+    return false;
+  }
+
+  bool text = type == ContentType::Text;
+  if (!text) {
+    stats_.binary++;
+  }
+
+  if (file.identity.isKnown()) {
+    pending_.emplace_back(file.identity, text);
+    if (pending_.size() >= FLUSH_THRESHOLD) {
+      flush();
+    }
+  }
+
+  return text;
+}
+
+void ContentClassCache::flush() {
+  if (pending_.empty()) {
+    return;
+  }
+
+  db_.putContentClasses(pending_);
+  pending_.clear();
+}
+
+} // namespace glint
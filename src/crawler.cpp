@@ -1,11 +1,14 @@
 #include "glint/crawler.h"
+#include "glint/memory_budget.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace glint {
 
 DirectoryCrawler::DirectoryCrawler(const std::filesystem::path &rootPath)
-    : rootPath_(rootPath), filesProcessed_(0) {}
+    : rootPath_(rootPath), memory_(nullptr), batchBytes_(0),
+      filesProcessed_(0) {}
 
 void DirectoryCrawler::setFileExtensions(
     const std::set<std::string> &extensions) {
@@ -16,6 +19,46 @@ void DirectoryCrawler::setProgressCallback(ProgressCallback callback) {
   progressCallback_ = callback;
 }
 
+void DirectoryCrawler::setFileFilter(FileFilter filter) {
+  fileFilter_ = filter;
+}
+
+void DirectoryCrawler::setBatchCallback(BatchCallback callback,
+                                        MemoryBudget &memory) {
+  batchCallback_ = callback;
+  memory_ = &memory;
+}
+
+void DirectoryCrawler::setResumeAfter(const std::filesystem::path &frontier) {
+  resumeAfter_ = frontier;
+}
+
+void DirectoryCrawler::setCancelled(std::function<bool()> cancelled) {
+  cancelled_ = cancelled;
+}
+
+// Entries are visited in sorted order, so the walk follows path::compare
+// and everything up to a checkpoint frontier can be skipped without a stat.
+// A directory is skipped only when the frontier does not lie inside it.
+bool DirectoryCrawler::isBeforeFrontier(const std::filesystem::path &path,
+                                        bool directory) const {
+  if (resumeAfter_.empty()) {
+    return false;
+  }
+
+  int order = path.compare(resumeAfter_);
+  if (!directory) {
+    return order <= 0;
+  }
+  if (order >= 0) {
+    return false;
+  }
+
+  auto [pathEnd, frontierEnd] = std::mismatch(
+      path.begin(), path.end(), resumeAfter_.begin(), resumeAfter_.end());
+  return pathEnd != path.end();
+}
+
 bool DirectoryCrawler::shouldProcessFile(
     const std::filesystem::path &path) const {
   if (!std::filesystem::is_regular_file(path)) {
@@ -37,31 +80,57 @@ bool DirectoryCrawler::shouldProcessFile(
 
 void DirectoryCrawler::crawlRecursive(const std::filesystem::path &dir,
                                       std::vector<FileInfo> &results) {
+  std::vector<std::filesystem::directory_entry> entries;
   try {
     for (const auto &entry : std::filesystem::directory_iterator(dir)) {
-      try {
-        if (std::filesystem::is_directory(entry)) {
-          auto dirname = entry.path().filename().string();
-          if (!dirname.empty() && dirname[0] != '.') {
-            crawlRecursive(entry.path(), results);
-          }
-        } else if (shouldProcessFile(entry.path())) {
-          FileInfo info(entry.path());
-          results.push_back(info);
-          filesProcessed_++;
+      entries.push_back(entry);
+    }
+  } catch (const std::filesystem::filesystem_error &e) {
+    std::cerr << "Error reading directory: " << dir << " - " << e.what()
+              << "\n";
+  }
+  std::sort(entries.begin(), entries.end());
+
+  for (const auto &entry : entries) {
+    if (cancelled_ && cancelled_()) {
+      return;
+    }
+
+    try {
+      if (std::filesystem::is_directory(entry)) {
+        auto dirname = entry.path().filename().string();
+        if (!dirname.empty() && dirname[0] != '.' &&
+            !isBeforeFrontier(entry.path(), true)) {
+          crawlRecursive(entry.path(), results);
+        }
+      } else if (!isBeforeFrontier(entry.path(), false) &&
+                 shouldProcessFile(entry.path())) {
+        FileInfo info(entry.path());
+        if (fileFilter_ && !fileFilter_(info)) {
+          continue;
+        }
+
+        results.push_back(info);
+        filesProcessed_++;
 
-          if (progressCallback_) {
-            progressCallback_(info);
+        if (progressCallback_) {
+          progressCallback_(info);
+        }
+
+        if (batchCallback_) {
+          size_t bytes = sizeof(FileInfo) + info.path.native().capacity() +
+                         info.extension.capacity();
+          batchBytes_ += bytes;
+          memory_->charge(MemoryComponent::Crawler, bytes);
+          if (memory_->exceeded(MemoryComponent::Crawler)) {
+            flushBatch(results);
           }
         }
-      } catch (const std::filesystem::filesystem_error &e) {
-        std::cerr << "Error accessing: " << entry.path() << " - " << e.what()
-                  << "\n";
       }
+    } catch (const std::filesystem::filesystem_error &e) {
+      std::cerr << "Error accessing: " << entry.path() << " - " << e.what()
+                << "\n";
     }
-  } catch (const std::filesystem::filesystem_error &e) {
-    std::cerr << "Error reading directory: " << dir << " - " << e.what()
-              << "\n";
   }
 }
 
@@ -80,7 +149,20 @@ std::vector<FileInfo> DirectoryCrawler::crawl() {
   }
 
   crawlRecursive(rootPath_, results);
+  if (batchCallback_) {
+    flushBatch(results);
+  }
   return results;
 }
 
+void DirectoryCrawler::flushBatch(std::vector<FileInfo> &results) {
+  if (!results.empty()) {
+    batchCallback_(results);
+  }
+  results.clear();
+  results.shrink_to_fit();
+  memory_->release(MemoryComponent::Crawler, batchBytes_);
+  batchBytes_ = 0;
+}
+
 } // namespace glint
@@ -1,29 +1,299 @@
 #include "glint/database.h"
+#include "glint/postings_cache.h"
+#include "glint/text_extractor.h"
+#include "glint/trigram.h"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <sqlite3.h>
-#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 
 namespace glint {
 
-Database::Database(const std::string &dbPath) : dbPath_(dbPath), db_(nullptr) {
-  int rc = sqlite3_open(dbPath_.c_str(), &db_);
-  if (rc != SQLITE_OK) {
-    std::string error = sqlite3_errmsg(db_);
-    sqlite3_close(db_);
-    throw std::runtime_error("Failed to open database: " + error);
+namespace {
+
+std::string foldPath(std::string_view path) {
+  std::string folded(path);
+  for (auto &c : folded) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+  }
+  return folded;
+}
+
+class CachedStatement {
+public:
+  explicit CachedStatement(sqlite3_stmt *stmt) : stmt_(stmt) {}
+  ~CachedStatement() {
+    if (stmt_) {
+      sqlite3_reset(stmt_);
+      sqlite3_clear_bindings(stmt_);
+    }
+  }
+
+  CachedStatement(const CachedStatement &) = delete;
+  CachedStatement &operator=(const CachedStatement &) = delete;
+
+  sqlite3_stmt *get() const { return stmt_; }
+  explicit operator bool() const { return stmt_ != nullptr; }
+
+private:
+  sqlite3_stmt *stmt_;
+};
+
+} // namespace
+
+struct Database::Connection {
+  sqlite3 *handle = nullptr;
+  std::unordered_map<std::string, sqlite3_stmt *> statements;
+
+  Connection(const std::string &path, int flags) {
+    int rc = sqlite3_open_v2(path.c_str(), &handle, flags, nullptr);
+    if (rc != SQLITE_OK) {
+      std::string error = handle ? sqlite3_errmsg(handle) : "out of memory";
+      sqlite3_close(handle);
+      throw std::runtime_error("Failed to open database: " + error);
+    }
+  }
+
+  ~Connection() {
+    for (auto &[sql, stmt] : statements) {
+      sqlite3_finalize(stmt);
+    }
+    sqlite3_close(handle);
+  }
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  CachedStatement prepare(const char *sql) {
+    auto it = statements.find(sql);
+    if (it != statements.end()) {
+      return CachedStatement(it->second);
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    int rc = sqlite3_prepare_v3(handle, sql, -1, SQLITE_PREPARE_PERSISTENT,
+                                &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+      sqlite3_finalize(stmt);
+      return CachedStatement(nullptr);
+    }
+
+    statements.emplace(sql, stmt);
+    return CachedStatement(stmt);
+  }
+};
+
+class Database::ReaderLease {
+public:
+  explicit ReaderLease(const Database &db)
+      : db_(db), conn_(nullptr), owned_(false) {
+    if (activeReadOwner_ == &db) {
+      conn_ = activeReadConnection_;
+    } else {
+      conn_ = db.acquireReader();
+      owned_ = true;
+    }
+  }
+
+  ~ReaderLease() {
+    if (owned_) {
+      db_.releaseReader(conn_);
+    }
+  }
+
+  ReaderLease(const ReaderLease &) = delete;
+  ReaderLease &operator=(const ReaderLease &) = delete;
+
+  Connection *operator->() const { return conn_; }
+  Connection &operator*() const { return *conn_; }
+
+private:
+  const Database &db_;
+  Connection *conn_;
+  bool owned_;
+};
+
+thread_local const Database *Database::activeReadOwner_ = nullptr;
+thread_local Database::Connection *Database::activeReadConnection_ = nullptr;
+
+Database::ReadTransaction::ReadTransaction(const Database &db)
+    : db_(db), conn_(nullptr) {
+  if (activeReadOwner_ == &db) {
+    return;
+  }
+
+  conn_ = db.acquireReader();
+  if (sqlite3_exec(conn_->handle, "BEGIN;", nullptr, nullptr, nullptr) !=
+      SQLITE_OK) {
+    db.releaseReader(conn_);
+    throw std::runtime_error("Failed to begin read transaction");
+  }
+
+  activeReadOwner_ = &db;
+  activeReadConnection_ = conn_;
+}
+
+Database::ReadTransaction::~ReadTransaction() {
+  if (!conn_) {
+    return;
+  }
+
+  sqlite3_exec(conn_->handle, "COMMIT;", nullptr, nullptr, nullptr);
+  activeReadOwner_ = nullptr;
+  activeReadConnection_ = nullptr;
+  db_.releaseReader(conn_);
+}
+
+Database::Database(const std::string &dbPath, const DatabaseOptions &options)
+    : dbPath_(dbPath), options_(options), db_(nullptr) {
+  // Pooled reads wait for an idle reader; without one they never return.
+  if (options_.readerCount == 0) {
+    throw std::invalid_argument("Database needs at least one reader");
   }
 
+  writer_ = std::make_unique<Connection>(
+      dbPath_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                   SQLITE_OPEN_NOMUTEX);
+  db_ = writer_->handle;
+
+  executeSQL("PRAGMA auto_vacuum=INCREMENTAL;");
   executeSQL("PRAGMA journal_mode=WAL;");
   executeSQL("PRAGMA synchronous=NORMAL;");
-  executeSQL("PRAGMA cache_size=10000;");
+  executeSQL(cacheSizePragma().c_str());
   executeSQL("PRAGMA temp_store=MEMORY;");
+
+  std::string journalLimit = "PRAGMA journal_size_limit=" +
+                             std::to_string(options_.checkpoint.journalSizeLimit) +
+                             ";";
+  executeSQL(journalLimit.c_str());
+  sqlite3_busy_timeout(db_, options_.checkpoint.busyTimeoutMs);
+  sqlite3_wal_hook(db_, &Database::walHook, this);
 }
 
 Database::~Database() {
-  if (db_) {
-    sqlite3_close(db_);
+  readers_.clear();
+  writer_.reset();
+}
+
+Database::Connection *Database::acquireReader() const {
+  std::unique_lock<std::mutex> lock(poolMutex_);
+
+  if (idleReaders_.empty() && readers_.size() < options_.readerCount) {
+    auto conn = std::make_unique<Connection>(
+        dbPath_, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+    sqlite3_busy_timeout(conn->handle, options_.checkpoint.busyTimeoutMs);
+    sqlite3_exec(conn->handle, cacheSizePragma().c_str(), nullptr, nullptr,
+                 nullptr);
+    readers_.push_back(std::move(conn));
+    return readers_.back().get();
+  }
+
+  poolAvailable_.wait(lock, [this] { return !idleReaders_.empty(); });
+  Connection *conn = idleReaders_.back();
+  idleReaders_.pop_back();
+  return conn;
+}
+
+void Database::releaseReader(Connection *conn) const {
+  {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    idleReaders_.push_back(conn);
+  }
+  poolAvailable_.notify_one();
+}
+
+int Database::walHook(void *context, sqlite3 *db, const char *dbName,
+                      int pages) {
+  auto *self = static_cast<Database *>(context);
+  const auto &policy = self->options_.checkpoint;
+
+  int mode = -1;
+  if (policy.truncatePages > 0 && pages >= policy.truncatePages) {
+    mode = SQLITE_CHECKPOINT_TRUNCATE;
+  } else if (policy.passivePages > 0 && pages >= policy.passivePages) {
+    mode = SQLITE_CHECKPOINT_PASSIVE;
+  }
+
+  std::lock_guard<std::mutex> lock(self->statsMutex_);
+  self->checkpointStats_.lastWalPages = pages;
+  if (mode < 0) {
+    return SQLITE_OK;
+  }
+
+  int rc = sqlite3_wal_checkpoint_v2(db, dbName, mode, nullptr, nullptr);
+  if (rc == SQLITE_BUSY) {
+    self->checkpointStats_.busy++;
+  } else if (mode == SQLITE_CHECKPOINT_TRUNCATE) {
+    self->checkpointStats_.truncate++;
+  } else {
+    self->checkpointStats_.passive++;
   }
+
+  return SQLITE_OK;
+}
+
+void Database::checkpoint() {
+  int rc = sqlite3_wal_checkpoint_v2(db_, nullptr, SQLITE_CHECKPOINT_TRUNCATE,
+                                     nullptr, nullptr);
+
+  std::lock_guard<std::mutex> lock(statsMutex_);
+  if (rc == SQLITE_BUSY) {
+    checkpointStats_.busy++;
+  } else {
+    checkpointStats_.truncate++;
+  }
+}
+
+CheckpointStats Database::getCheckpointStats() const {
+  std::lock_guard<std::mutex> lock(statsMutex_);
+  return checkpointStats_;
+}
+
+std::string Database::cacheSizePragma() const {
+  // A negative cache_size is a limit in KiB rather than in pages.
+  return "PRAGMA cache_size=-" +
+         std::to_string(std::max<size_t>(options_.connectionCacheBytes / 1024,
+                                         64)) +
+         ";";
+}
+
+size_t Database::getCacheMemory() const {
+  auto cacheUsed = [](sqlite3 *handle) {
+    int current = 0;
+    int highwater = 0;
+    sqlite3_db_status(handle, SQLITE_DBSTATUS_CACHE_USED, &current,
+                      &highwater, 0);
+    return static_cast<size_t>(current);
+  };
+
+  size_t total = cacheUsed(db_);
+  std::lock_guard<std::mutex> lock(poolMutex_);
+  for (const auto &reader : readers_) {
+    total += cacheUsed(reader->handle);
+  }
+  return total;
+}
+
+PageCacheStats Database::getPageCacheStats() const {
+  auto counter = [](sqlite3 *handle, int op) {
+    int current = 0;
+    int highwater = 0;
+    sqlite3_db_status(handle, op, &current, &highwater, 0);
+    return static_cast<int64_t>(current);
+  };
+
+  PageCacheStats stats;
+  std::lock_guard<std::mutex> lock(poolMutex_);
+  for (const auto &reader : readers_) {
+    stats.hits += counter(reader->handle, SQLITE_DBSTATUS_CACHE_HIT);
+    stats.misses += counter(reader->handle, SQLITE_DBSTATUS_CACHE_MISS);
+  }
+  return stats;
 }
 
 void Database::executeSQL(const char *sql) {
@@ -44,16 +314,16 @@ void Database::initialize() {
             path TEXT UNIQUE NOT NULL,
             size INTEGER NOT NULL,
             modified_time INTEGER NOT NULL,
-            extension TEXT
+            extension TEXT,
+            content_hash INTEGER
         );
-        CREATE INDEX IF NOT EXISTS idx_path ON files(path);
-        CREATE INDEX IF NOT EXISTS idx_extension ON files(extension);
+        CREATE INDEX IF NOT EXISTS idx_files_content_hash
+            ON files(content_hash);
 
         CREATE TABLE IF NOT EXISTS tokens (
             id INTEGER PRIMARY KEY AUTOINCREMENT,
             token TEXT UNIQUE NOT NULL
         );
-        CREATE INDEX IF NOT EXISTS idx_token ON tokens(token);
 
         CREATE TABLE IF NOT EXISTS token_files (
             token_id INTEGER NOT NULL,
@@ -62,34 +332,112 @@ void Database::initialize() {
             PRIMARY KEY (token_id, file_id),
             FOREIGN KEY (token_id) REFERENCES tokens(id),
             FOREIGN KEY (file_id) REFERENCES files(id)
-        );
-        CREATE INDEX IF NOT EXISTS idx_token_files_token ON token_files(token_id);
+        ) WITHOUT ROWID;
         CREATE INDEX IF NOT EXISTS idx_token_files_file ON token_files(file_id);
-    )";
 
-  executeSQL(createTableSQL);
-}
+        CREATE TABLE IF NOT EXISTS documents (
+            file_id INTEGER PRIMARY KEY,
+            block_offset INTEGER NOT NULL,
+            doc_offset INTEGER NOT NULL,
+            doc_length INTEGER NOT NULL
+        );
 
-void Database::insertFile(const FileInfo &file) {
-  auto timePoint = file.lastModified.time_since_epoch().count();
+        CREATE TABLE IF NOT EXISTS content_classes (
+            device INTEGER NOT NULL,
+            inode INTEGER NOT NULL,
+            modified_time INTEGER NOT NULL,
+            is_text INTEGER NOT NULL,
+            PRIMARY KEY (device, inode)
+        ) WITHOUT ROWID;
 
-  std::ostringstream sql;
-  sql << "INSERT OR REPLACE INTO files (path, size, modified_time, extension) "
-         "VALUES ("
-      << "'" << file.path.string() << "', " << file.size << ", " << timePoint
-      << ", "
-      << "'" << file.extension << "');";
+        CREATE TABLE IF NOT EXISTS token_blocks (
+            token_id INTEGER NOT NULL,
+            last_file_id INTEGER NOT NULL,
+            max_frequency INTEGER NOT NULL,
+            PRIMARY KEY (token_id, last_file_id)
+        ) WITHOUT ROWID;
 
-  executeSQL(sql.str().c_str());
-}
+        CREATE TABLE IF NOT EXISTS stale_bounds (
+            token_id INTEGER PRIMARY KEY
+        );
 
-void Database::insertFiles(const std::vector<FileInfo> &files) {
-  executeSQL("BEGIN TRANSACTION;");
+        CREATE TABLE IF NOT EXISTS path_trigrams (
+            trigram INTEGER NOT NULL,
+            file_id INTEGER NOT NULL,
+            PRIMARY KEY (trigram, file_id)
+        ) WITHOUT ROWID;
+
+        CREATE TABLE IF NOT EXISTS content_trigrams (
+            trigram INTEGER NOT NULL,
+            file_id INTEGER NOT NULL,
+            PRIMARY KEY (trigram, file_id)
+        ) WITHOUT ROWID;
+
+        CREATE TABLE IF NOT EXISTS trigram_files (
+            file_id INTEGER PRIMARY KEY
+        );
+
+        CREATE TABLE IF NOT EXISTS crawl_checkpoints (
+            root TEXT PRIMARY KEY,
+            frontier TEXT NOT NULL,
+            pending TEXT NOT NULL,
+            files INTEGER NOT NULL
+        );
+
+        CREATE TABLE IF NOT EXISTS streamed_files (
+            file_id INTEGER PRIMARY KEY
+        );
+    )";
+
+  int version = getSchemaVersion();
+  if (version == SCHEMA_VERSION) {
+    return;
+  }
+  if (version > SCHEMA_VERSION) {
+    throw std::runtime_error("Database schema version " +
+                             std::to_string(version) +
+                             " is newer than supported version " +
+                             std::to_string(SCHEMA_VERSION));
+  }
+
+  executeSQL("BEGIN IMMEDIATE;");
 
   try {
-    for (const auto &file : files) {
-      insertFile(file);
+    if (version == 0 && !tableExists(*writer_, "token_files")) {
+      executeSQL(createTableSQL);
+    } else {
+      if (version < 2) {
+        migrateFromV1();
+      }
+      if (version < 3) {
+        migrateFromV2();
+      }
+      if (version < 4) {
+        migrateFromV3();
+      }
+      if (version < 5) {
+        migrateFromV4();
+      }
+      if (version < 6) {
+        migrateFromV5();
+      }
+      if (version < 7) {
+        migrateFromV6();
+      }
+      if (version < 8) {
+        migrateFromV7();
+      }
+      if (version < 9) {
+        migrateFromV8();
+      }
+      if (version < 10) {
+        migrateFromV9();
+      }
     }
+
+    std::string setVersion =
+        "PRAGMA user_version=" + std::to_string(SCHEMA_VERSION) + ";";
+    executeSQL(setVersion.c_str());
     executeSQL("COMMIT;");
   } catch (...) {
     executeSQL("ROLLBACK;");
@@ -97,194 +445,2046 @@ void Database::insertFiles(const std::vector<FileInfo> &files) {
   }
 }
 
-void Database::insertToken(const std::string &token, int fileId,
-                           int frequency) {
-  std::ostringstream sql;
-  sql << "INSERT OR IGNORE INTO tokens (token) VALUES ('" << token << "');";
-  executeSQL(sql.str().c_str());
+void Database::migrateFromV1() {
+  const char *migrateSQL = R"(
+        DROP INDEX IF EXISTS idx_path;
+        DROP INDEX IF EXISTS idx_extension;
+        DROP INDEX IF EXISTS idx_token;
+        DROP INDEX IF EXISTS idx_token_files_token;
+        DROP INDEX IF EXISTS idx_token_files_file;
+
+        CREATE TABLE token_files_v2 (
+            token_id INTEGER NOT NULL,
+            file_id INTEGER NOT NULL,
+            frequency INTEGER NOT NULL,
+            PRIMARY KEY (token_id, file_id),
+            FOREIGN KEY (token_id) REFERENCES tokens(id),
+            FOREIGN KEY (file_id) REFERENCES files(id)
+        ) WITHOUT ROWID;
+
+        INSERT INTO token_files_v2 (token_id, file_id, frequency)
+        SELECT token_id, file_id, frequency FROM token_files
+        ORDER BY token_id, file_id;
+
+        DROP TABLE token_files;
+        ALTER TABLE token_files_v2 RENAME TO token_files;
+        CREATE INDEX idx_token_files_file ON token_files(file_id);
+    )";
 
-  sql.str("");
-  sql << "INSERT OR REPLACE INTO token_files (token_id, file_id, frequency) "
-      << "VALUES ((SELECT id FROM tokens WHERE token = '" << token << "'), "
-      << fileId << ", " << frequency << ");";
-  executeSQL(sql.str().c_str());
+  executeSQL(migrateSQL);
 }
 
-void Database::insertTokens(
-    const std::vector<std::tuple<std::string, int, int>> &tokens) {
-  executeSQL("BEGIN TRANSACTION;");
+void Database::migrateFromV2() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS documents (
+            file_id INTEGER PRIMARY KEY,
+            block_offset INTEGER NOT NULL,
+            doc_offset INTEGER NOT NULL,
+            doc_length INTEGER NOT NULL
+        );
+    )");
+}
 
-  try {
-    for (const auto &[token, fileId, frequency] : tokens) {
-      insertToken(token, fileId, frequency);
-    }
-    executeSQL("COMMIT;");
-  } catch (...) {
-    executeSQL("ROLLBACK;");
-    throw;
-  }
+void Database::migrateFromV3() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS content_classes (
+            device INTEGER NOT NULL,
+            inode INTEGER NOT NULL,
+            modified_time INTEGER NOT NULL,
+            is_text INTEGER NOT NULL,
+            PRIMARY KEY (device, inode)
+        ) WITHOUT ROWID;
+    )");
 }
 
-size_t Database::getFileCount() const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT COUNT(*) FROM files;";
+void Database::migrateFromV4() {
+  executeSQL(R"(
+        ALTER TABLE files ADD COLUMN content_hash INTEGER;
+        CREATE INDEX IF NOT EXISTS idx_files_content_hash
+            ON files(content_hash);
+    )");
+}
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return 0;
+void Database::migrateFromV5() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS token_blocks (
+            token_id INTEGER NOT NULL,
+            last_file_id INTEGER NOT NULL,
+            max_frequency INTEGER NOT NULL,
+            PRIMARY KEY (token_id, last_file_id)
+        ) WITHOUT ROWID;
+
+        CREATE TABLE IF NOT EXISTS stale_bounds (
+            token_id INTEGER PRIMARY KEY
+        );
+
+        INSERT OR IGNORE INTO stale_bounds (token_id) SELECT id FROM tokens;
+    )");
+}
+
+void Database::migrateFromV6() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS path_trigrams (
+            trigram INTEGER NOT NULL,
+            file_id INTEGER NOT NULL,
+            PRIMARY KEY (trigram, file_id)
+        ) WITHOUT ROWID;
+    )");
+
+  std::vector<std::pair<int, std::string>> files;
+  {
+    auto stmt = writer_->prepare("SELECT id, path FROM files;");
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      const char *path =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      files.emplace_back(sqlite3_column_int(stmt.get(), 0), path ? path : "");
+    }
   }
 
-  size_t count = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    count = sqlite3_column_int64(stmt, 0);
+  std::vector<std::pair<uint32_t, int>> trigrams;
+  for (const auto &[fileId, path] : files) {
+    for (uint32_t trigram : extractTrigrams(path)) {
+      trigrams.emplace_back(trigram, fileId);
+    }
   }
+  std::sort(trigrams.begin(), trigrams.end());
+  insertTrigramRows(trigrams);
+}
 
-  sqlite3_finalize(stmt);
-  return count;
+void Database::migrateFromV7() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS content_trigrams (
+            trigram INTEGER NOT NULL,
+            file_id INTEGER NOT NULL,
+            PRIMARY KEY (trigram, file_id)
+        ) WITHOUT ROWID;
+
+        CREATE TABLE IF NOT EXISTS trigram_files (
+            file_id INTEGER PRIMARY KEY
+        );
+    )");
 }
 
-size_t Database::getTokenCount() const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT COUNT(*) FROM tokens;";
+void Database::migrateFromV8() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS crawl_checkpoints (
+            root TEXT PRIMARY KEY,
+            frontier TEXT NOT NULL,
+            pending TEXT NOT NULL,
+            files INTEGER NOT NULL
+        );
+    )");
+}
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return 0;
+void Database::migrateFromV9() {
+  executeSQL(R"(
+        CREATE TABLE IF NOT EXISTS streamed_files (
+            file_id INTEGER PRIMARY KEY
+        );
+    )");
+
+  // Older crawls streamed exactly the files above the default size limit.
+  auto stmt = writer_->prepare(
+      "INSERT OR IGNORE INTO streamed_files (file_id) "
+      "SELECT DISTINCT file_id FROM token_files WHERE file_id IN "
+      "(SELECT id FROM files WHERE size > ?);");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
   }
+  sqlite3_bind_int64(stmt.get(), 1,
+                     static_cast<int64_t>(TextExtractor::MAX_FILE_SIZE));
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+}
 
-  size_t count = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    count = sqlite3_column_int64(stmt, 0);
+void Database::insertPathTrigrams(int fileId, const std::string &path) {
+  std::vector<std::pair<uint32_t, int>> trigrams;
+  for (uint32_t trigram : extractTrigrams(path)) {
+    trigrams.emplace_back(trigram, fileId);
+  }
+  insertTrigramRows(trigrams);
+}
+
+void Database::insertTrigramRows(
+    const std::vector<std::pair<uint32_t, int>> &trigrams) {
+  auto stmt = writer_->prepare(
+      "INSERT OR IGNORE INTO path_trigrams (trigram, file_id) VALUES (?, ?);");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
   }
 
-  sqlite3_finalize(stmt);
-  return count;
+  for (const auto &[trigram, fileId] : trigrams) {
+    sqlite3_bind_int(stmt.get(), 1, static_cast<int>(trigram));
+    sqlite3_bind_int(stmt.get(), 2, fileId);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_reset(stmt.get());
+  }
 }
 
-int Database::getFileId(const std::string &path) const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT id FROM files WHERE path = ?;";
+std::optional<CrawlCheckpoint>
+Database::getCrawlCheckpoint(const std::string &root) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT frontier, pending, files "
+                               "FROM crawl_checkpoints WHERE root = ?;");
+  if (!stmt) {
+    return std::nullopt;
+  }
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return -1;
+  sqlite3_bind_text(stmt.get(), 1, root.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return std::nullopt;
   }
 
-  sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
+  CrawlCheckpoint checkpoint;
+  checkpoint.root = root;
+  checkpoint.frontier =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+  checkpoint.pending =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+  checkpoint.files = static_cast<size_t>(sqlite3_column_int64(stmt.get(), 2));
+  return checkpoint;
+}
 
-  int fileId = -1;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    fileId = sqlite3_column_int(stmt, 0);
+void Database::putCrawlCheckpoint(const CrawlCheckpoint &checkpoint) {
+  auto stmt = writer_->prepare(
+      "INSERT OR REPLACE INTO crawl_checkpoints "
+      "(root, frontier, pending, files) VALUES (?, ?, ?, ?);");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
   }
 
-  sqlite3_finalize(stmt);
-  return fileId;
+  sqlite3_bind_text(stmt.get(), 1, checkpoint.root.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(stmt.get(), 2, checkpoint.frontier.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(stmt.get(), 3, checkpoint.pending.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_int64(stmt.get(), 4,
+                     static_cast<sqlite3_int64>(checkpoint.files));
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
 }
 
-std::string Database::getFilePath(int fileId) const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT path FROM files WHERE id = ?;";
+void Database::deleteCrawlCheckpoint(const std::string &root) {
+  auto stmt =
+      writer_->prepare("DELETE FROM crawl_checkpoints WHERE root = ?;");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return "";
+  sqlite3_bind_text(stmt.get(), 1, root.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
   }
+}
 
-  sqlite3_bind_int(stmt, 1, fileId);
+int Database::getSchemaVersion() const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("PRAGMA user_version;");
+  if (!stmt) {
+    return 0;
+  }
 
-  std::string path;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    const char *pathStr =
-        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-    if (pathStr) {
-      path = pathStr;
-    }
+  int version = 0;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    version = sqlite3_column_int(stmt.get(), 0);
   }
 
-  sqlite3_finalize(stmt);
-  return path;
+  return version;
 }
 
-std::vector<std::pair<int, int>>
-Database::searchToken(const std::string &token) const {
-  std::vector<std::pair<int, int>> results;
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = R"(
-    SELECT tf.file_id, tf.frequency
-    FROM token_files tf
-    JOIN tokens t ON tf.token_id = t.id
-    WHERE t.token = ?;
-  )";
+bool Database::tableExists(Connection &conn, const char *name) const {
+  auto stmt = conn.prepare(
+      "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?;");
+  if (!stmt) {
+    return false;
+  }
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return results;
+  sqlite3_bind_text(stmt.get(), 1, name, -1, SQLITE_STATIC);
+  return sqlite3_step(stmt.get()) == SQLITE_ROW;
+}
+
+int64_t Database::queryPragma(Connection &conn, const char *sql) const {
+  auto stmt = conn.prepare(sql);
+  if (!stmt || sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return 0;
   }
+  return sqlite3_column_int64(stmt.get(), 0);
+}
 
-  sqlite3_bind_text(stmt, 1, token.c_str(), -1, SQLITE_STATIC);
+std::uintmax_t Database::getDatabaseSize() const {
+  ReaderLease reader(*this);
+  auto pages = reader->prepare("PRAGMA page_count;");
+  auto pageSize = reader->prepare("PRAGMA page_size;");
+  if (!pages || !pageSize) {
+    return 0;
+  }
 
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    int fileId = sqlite3_column_int(stmt, 0);
-    int frequency = sqlite3_column_int(stmt, 1);
-    results.emplace_back(fileId, frequency);
+  if (sqlite3_step(pages.get()) != SQLITE_ROW ||
+      sqlite3_step(pageSize.get()) != SQLITE_ROW) {
+    return 0;
   }
 
-  sqlite3_finalize(stmt);
-  return results;
+  return static_cast<std::uintmax_t>(sqlite3_column_int64(pages.get(), 0)) *
+         static_cast<std::uintmax_t>(sqlite3_column_int64(pageSize.get(), 0));
 }
 
-bool Database::isFileModified(const std::string &path,
-                              std::filesystem::file_time_type modTime) const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT modified_time FROM files WHERE path = ?;";
+void Database::insertFile(const FileInfo &file) {
+  int fileId = upsertFile(file);
+  if (fileId != -1) {
+    insertPathTrigrams(fileId, file.path.string());
+  }
+}
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    return true;
+int Database::upsertFile(const FileInfo &file) {
+  auto timePoint = file.lastModified.time_since_epoch().count();
+  std::string path = file.path.string();
+
+  {
+    auto insert = writer_->prepare(
+        "INSERT OR IGNORE INTO files (path, size, modified_time, extension) "
+        "VALUES (?, ?, ?, ?);");
+    if (!insert) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    sqlite3_bind_text(insert.get(), 1, path.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(insert.get(), 2, static_cast<sqlite3_int64>(file.size));
+    sqlite3_bind_int64(insert.get(), 3, timePoint);
+    sqlite3_bind_text(insert.get(), 4, file.extension.c_str(), -1,
+                      SQLITE_STATIC);
+
+    if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
   }
 
-  sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_changes(db_) > 0) {
+    return static_cast<int>(sqlite3_last_insert_rowid(db_));
+  }
 
-  bool modified = true;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    int64_t storedTime = sqlite3_column_int64(stmt, 0);
-    int64_t currentTime = modTime.time_since_epoch().count();
-    modified = (storedTime != currentTime);
+  auto update = writer_->prepare(
+      "UPDATE files SET size = ?, modified_time = ?, extension = ? "
+      "WHERE path = ?;");
+  if (!update) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
   }
 
-  sqlite3_finalize(stmt);
-  return modified;
-}
+  sqlite3_bind_int64(update.get(), 1, static_cast<sqlite3_int64>(file.size));
+  sqlite3_bind_int64(update.get(), 2, timePoint);
+  sqlite3_bind_text(update.get(), 3, file.extension.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(update.get(), 4, path.c_str(), -1, SQLITE_STATIC);
 
-void Database::deleteFileTokens(int fileId) {
-  std::ostringstream sql;
-  sql << "DELETE FROM token_files WHERE file_id = " << fileId << ";";
-  executeSQL(sql.str().c_str());
+  if (sqlite3_step(update.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+  return -1;
 }
 
-void Database::optimizeDatabase() {
-  executeSQL("ANALYZE;");
-  executeSQL("VACUUM;");
+void Database::insertFiles(const std::vector<FileInfo> &files) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    std::vector<std::pair<uint32_t, int>> trigrams;
+    for (const auto &file : files) {
+      int fileId = upsertFile(file);
+      if (fileId != -1) {
+        for (uint32_t trigram : extractTrigrams(file.path.string())) {
+          trigrams.emplace_back(trigram, fileId);
+        }
+      }
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    insertTrigramRows(trigrams);
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
 }
 
-bool Database::hasFileTokens(int fileId) const {
-  sqlite3_stmt *stmt = nullptr;
-  const char *sql = "SELECT COUNT(*) FROM token_files WHERE file_id = ?;";
+void Database::insertToken(const std::string &token, int fileId,
+                           int frequency) {
+  {
+    auto insert =
+        writer_->prepare("INSERT OR IGNORE INTO tokens (token) VALUES (?);");
+    if (!insert) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_text(insert.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
 
-  int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
+  {
+    auto stale = writer_->prepare(
+        "INSERT OR IGNORE INTO stale_bounds (token_id) "
+        "SELECT id FROM tokens WHERE token = ?;");
+    if (!stale) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_text(stale.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stale.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
+
+  auto posting = writer_->prepare(
+      "INSERT OR REPLACE INTO token_files (token_id, file_id, frequency) "
+      "VALUES ((SELECT id FROM tokens WHERE token = ?), ?, ?);");
+  if (!posting) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+
+  sqlite3_bind_text(posting.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int(posting.get(), 2, fileId);
+  sqlite3_bind_int(posting.get(), 3, frequency);
+  if (sqlite3_step(posting.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+}
+
+void Database::insertTokens(
+    const std::vector<std::tuple<std::string, int, int>> &tokens) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    for (const auto &[token, fileId, frequency] : tokens) {
+      insertToken(token, fileId, frequency);
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+}
+
+size_t Database::bulkLoadPostings(const PostingsSource &source) {
+  std::string token;
+  std::vector<std::pair<int, int>> postings;
+  size_t loaded = 0;
+
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    while (source(token, postings)) {
+      {
+        auto insert =
+            writer_->prepare("INSERT OR IGNORE INTO tokens (token) VALUES (?);");
+        if (!insert) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+        sqlite3_bind_text(insert.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+      }
+
+      sqlite3_int64 tokenId = sqlite3_last_insert_rowid(db_);
+      if (sqlite3_changes(db_) == 0) {
+        auto lookup = writer_->prepare("SELECT id FROM tokens WHERE token = ?;");
+        if (!lookup) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+        sqlite3_bind_text(lookup.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(lookup.get()) != SQLITE_ROW) {
+          throw std::runtime_error("Failed to resolve token id: " + token);
+        }
+        tokenId = sqlite3_column_int64(lookup.get(), 0);
+      }
+
+      {
+        auto stale = writer_->prepare(
+            "INSERT OR IGNORE INTO stale_bounds (token_id) VALUES (?);");
+        if (!stale) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+        sqlite3_bind_int64(stale.get(), 1, tokenId);
+        if (sqlite3_step(stale.get()) != SQLITE_DONE) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+      }
+
+      auto posting = writer_->prepare(
+          "INSERT OR REPLACE INTO token_files (token_id, file_id, frequency) "
+          "VALUES (?, ?, ?);");
+      if (!posting) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+
+      for (const auto &[fileId, frequency] : postings) {
+        sqlite3_bind_int64(posting.get(), 1, tokenId);
+        sqlite3_bind_int(posting.get(), 2, fileId);
+        sqlite3_bind_int(posting.get(), 3, frequency);
+        if (sqlite3_step(posting.get()) != SQLITE_DONE) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+        sqlite3_reset(posting.get());
+      }
+
+      loaded += postings.size();
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+
+  return loaded;
+}
+
+// Merges another index into this one with set-based statements over an
+// attached copy, so postings stream through SQLite's sorter (spilling to
+// disk) instead of being loaded. Paths in both keep the newer version.
+MergeStats Database::mergeFrom(const std::string &sourcePath) {
+  MergeStats stats;
+
+  executeSQL("PRAGMA temp_store=FILE;");
+  {
+    auto attach = writer_->prepare("ATTACH DATABASE ? AS source;");
+    if (!attach) {
+      executeSQL("PRAGMA temp_store=MEMORY;");
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_text(attach.get(), 1, sourcePath.c_str(), -1,
+                      SQLITE_STATIC);
+    if (sqlite3_step(attach.get()) != SQLITE_DONE) {
+      executeSQL("PRAGMA temp_store=MEMORY;");
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
+
+  auto detach = [this] {
+    sqlite3_exec(db_,
+                 "DROP TABLE IF EXISTS temp.merge_files;"
+                 "DROP TABLE IF EXISTS temp.merge_tokens;"
+                 "DETACH DATABASE source;"
+                 "PRAGMA temp_store=MEMORY;",
+                 nullptr, nullptr, nullptr);
+  };
+
+  int64_t version = queryPragma(*writer_, "PRAGMA source.user_version;");
+  if (version != SCHEMA_VERSION) {
+    detach();
+    throw std::runtime_error(sourcePath + " has schema version " +
+                             std::to_string(version) + ", expected " +
+                             std::to_string(SCHEMA_VERSION) +
+                             "; crawl it with this version first");
+  }
+
+  auto count = [this](const char *sql) {
+    return static_cast<size_t>(queryPragma(*writer_, sql));
+  };
+
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    executeSQL(R"(
+        CREATE TEMP TABLE merge_files (
+            source_id INTEGER PRIMARY KEY,
+            target_id INTEGER,
+            added INTEGER NOT NULL,
+            postings_from INTEGER
+        );
+        INSERT INTO merge_files (source_id, target_id, added)
+        SELECT s.id, f.id, f.id IS NULL FROM source.files s
+        LEFT JOIN main.files f ON f.path = s.path
+        WHERE f.id IS NULL OR f.modified_time < s.modified_time;
+    )");
+
+    stats.filesSkipped = count("SELECT COUNT(*) FROM source.files;") -
+                         count("SELECT COUNT(*) FROM merge_files;");
+
+    std::vector<int> replaced;
+    {
+      auto stmt = writer_->prepare(
+          "SELECT target_id FROM merge_files WHERE added = 0;");
+      if (!stmt) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        replaced.push_back(sqlite3_column_int(stmt.get(), 0));
+      }
+    }
+
+    // Older versions hand their postings to a same-content copy, as during
+    // a crawl. Clearing the hash keeps them from being chosen as an heir.
+    for (int fileId : replaced) {
+      releaseContent(fileId);
+      auto clear = writer_->prepare(
+          "UPDATE files SET content_hash = NULL WHERE id = ?;");
+      if (!clear) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_bind_int(clear.get(), 1, fileId);
+      if (sqlite3_step(clear.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+    }
+    stats.filesReplaced = replaced.size();
+
+    executeSQL(R"(
+        UPDATE main.files
+        SET (size, modified_time, extension, content_hash) = (
+            SELECT s.size, s.modified_time, s.extension, s.content_hash
+            FROM merge_files m JOIN source.files s ON s.id = m.source_id
+            WHERE m.target_id = main.files.id AND m.added = 0)
+        WHERE id IN (SELECT target_id FROM merge_files WHERE added = 0);
+
+        INSERT INTO main.files (path, size, modified_time, extension,
+                                content_hash)
+        SELECT s.path, s.size, s.modified_time, s.extension, s.content_hash
+        FROM merge_files m JOIN source.files s ON s.id = m.source_id
+        WHERE m.added = 1 ORDER BY m.source_id;
+
+        UPDATE merge_files SET target_id = (
+            SELECT f.id FROM source.files s
+            JOIN main.files f ON f.path = s.path
+            WHERE s.id = merge_files.source_id)
+        WHERE added = 1;
+
+        INSERT OR IGNORE INTO main.path_trigrams (trigram, file_id)
+        SELECT pt.trigram, m.target_id FROM source.path_trigrams pt
+        JOIN merge_files m ON m.source_id = pt.file_id AND m.added = 1;
+    )");
+    stats.filesAdded =
+        count("SELECT COUNT(*) FROM merge_files WHERE added = 1;");
+
+    // Each content keeps a single owner of postings. Files whose content is
+    // already owned here become copies; copies whose owner was not taken
+    // borrow the owner's postings, once per content.
+    executeSQL(R"(
+        UPDATE merge_files SET postings_from = source_id
+        WHERE EXISTS (SELECT 1 FROM source.token_files tf
+                      WHERE tf.file_id = merge_files.source_id);
+
+        UPDATE merge_files SET postings_from = NULL
+        WHERE postings_from IS NOT NULL AND EXISTS (
+            SELECT 1 FROM source.files s
+            JOIN main.files o ON o.content_hash = s.content_hash
+            WHERE s.id = merge_files.source_id
+              AND o.id != merge_files.target_id
+              AND EXISTS (SELECT 1 FROM main.token_files tf
+                          WHERE tf.file_id = o.id));
+
+        UPDATE merge_files SET postings_from = (
+            SELECT o.id FROM source.files s
+            JOIN source.files o ON o.content_hash = s.content_hash
+            WHERE s.id = merge_files.source_id
+              AND EXISTS (SELECT 1 FROM source.token_files tf
+                          WHERE tf.file_id = o.id))
+        WHERE postings_from IS NULL
+          AND source_id = (
+            SELECT MIN(m.source_id) FROM merge_files m
+            JOIN source.files s ON s.id = m.source_id
+            JOIN source.files self ON self.content_hash = s.content_hash
+            WHERE self.id = merge_files.source_id)
+          AND NOT EXISTS (
+            SELECT 1 FROM source.files self
+            JOIN main.files o ON o.content_hash = self.content_hash
+            WHERE self.id = merge_files.source_id
+              AND EXISTS (SELECT 1 FROM main.token_files tf
+                          WHERE tf.file_id = o.id))
+          AND NOT EXISTS (
+            SELECT 1 FROM source.files self
+            JOIN source.files s ON s.content_hash = self.content_hash
+            JOIN merge_files m ON m.source_id = s.id
+            WHERE self.id = merge_files.source_id
+              AND m.postings_from IS NOT NULL);
+
+        CREATE INDEX temp.merge_files_postings ON merge_files(postings_from);
+
+        INSERT OR IGNORE INTO main.tokens (token)
+        SELECT token FROM source.tokens ORDER BY token;
+
+        CREATE TEMP TABLE merge_tokens (
+            source_id INTEGER PRIMARY KEY,
+            target_id INTEGER NOT NULL
+        );
+        INSERT INTO merge_tokens (source_id, target_id)
+        SELECT s.id, t.id FROM source.tokens s
+        JOIN main.tokens t ON t.token = s.token;
+
+        INSERT OR IGNORE INTO main.stale_bounds (token_id)
+        SELECT target_id FROM merge_tokens;
+    )");
+
+    executeSQL(R"(
+        INSERT OR REPLACE INTO main.token_files (token_id, file_id, frequency)
+        SELECT t.target_id, m.target_id, tf.frequency
+        FROM source.token_files tf
+        JOIN merge_files m ON m.postings_from = tf.file_id
+        JOIN merge_tokens t ON t.source_id = tf.token_id
+        ORDER BY 1, 2;
+    )");
+    stats.postingsMerged = static_cast<size_t>(sqlite3_changes(db_));
+
+    executeSQL(R"(
+        INSERT OR IGNORE INTO main.content_trigrams (trigram, file_id)
+        SELECT ct.trigram, m.target_id FROM source.content_trigrams ct
+        JOIN merge_files m ON m.postings_from = ct.file_id
+        ORDER BY 1, 2;
+
+        INSERT OR IGNORE INTO main.trigram_files (file_id)
+        SELECT m.target_id FROM source.trigram_files t
+        JOIN merge_files m ON m.postings_from = t.file_id;
+
+        INSERT OR IGNORE INTO main.streamed_files (file_id)
+        SELECT m.target_id FROM source.streamed_files s
+        JOIN merge_files m ON m.postings_from = s.file_id;
+    )");
+
+    {
+      auto stmt = writer_->prepare(
+          "SELECT m.postings_from, m.target_id FROM merge_files m "
+          "JOIN source.documents d ON d.file_id = m.postings_from "
+          "ORDER BY d.block_offset, d.doc_offset;");
+      if (!stmt) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        stats.documents.emplace_back(sqlite3_column_int(stmt.get(), 0),
+                                     sqlite3_column_int(stmt.get(), 1));
+      }
+    }
+
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    releasedTokens_.clear();
+    detach();
+    throw;
+  }
+
+  invalidateReleasedTokens();
+  detach();
+  return stats;
+}
+
+size_t Database::getFileCount() const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT COUNT(*) FROM files;");
+  if (!stmt) {
+    return 0;
+  }
+
+  size_t count = 0;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    count = sqlite3_column_int64(stmt.get(), 0);
+  }
+
+  return count;
+}
+
+size_t Database::getTokenCount() const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT COUNT(*) FROM tokens;");
+  if (!stmt) {
+    return 0;
+  }
+
+  size_t count = 0;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    count = sqlite3_column_int64(stmt.get(), 0);
+  }
+
+  return count;
+}
+
+int Database::getFileId(const std::string &path) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT id FROM files WHERE path = ?;");
+  if (!stmt) {
+    return -1;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, path.c_str(), -1, SQLITE_STATIC);
+
+  int fileId = -1;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    fileId = sqlite3_column_int(stmt.get(), 0);
+  }
+
+  return fileId;
+}
+
+std::string Database::getFilePath(int fileId) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT path FROM files WHERE id = ?;");
+  if (!stmt) {
+    return "";
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+
+  std::string path;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const char *pathStr =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+    if (pathStr) {
+      path = pathStr;
+    }
+  }
+
+  return path;
+}
+
+std::vector<std::pair<int, int>>
+Database::searchToken(const std::string &token) const {
+  std::vector<std::pair<int, int>> results;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(R"(
+    SELECT tf.file_id, tf.frequency
+    FROM token_files tf
+    JOIN tokens t ON tf.token_id = t.id
+    WHERE t.token = ?;
+  )");
+  if (!stmt) {
+    return results;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    int fileId = sqlite3_column_int(stmt.get(), 0);
+    int frequency = sqlite3_column_int(stmt.get(), 1);
+    results.emplace_back(fileId, frequency);
+  }
+
+  return results;
+}
+
+std::optional<int64_t> Database::getTokenId(const std::string &token) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT id FROM tokens WHERE token = ?;");
+  if (!stmt) {
+    return std::nullopt;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, token.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return std::nullopt;
+  }
+  return sqlite3_column_int64(stmt.get(), 0);
+}
+
+std::vector<std::string>
+Database::getTokensWithPrefix(const std::string &prefix, size_t limit) const {
+  std::vector<std::string> tokens;
+  if (prefix.empty()) {
+    return tokens;
+  }
+
+  std::string high = prefix;
+  high.back()++;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT token FROM tokens WHERE token >= ? AND token < ? "
+      "ORDER BY token LIMIT ?;");
+  if (!stmt) {
+    return tokens;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, prefix.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt.get(), 2, high.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(limit));
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const char *token =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+    tokens.emplace_back(token ? token : "");
+  }
+
+  return tokens;
+}
+
+std::vector<std::pair<int, int>>
+Database::readPostings(int64_t tokenId, int firstFileId, int lastFileId) const {
+  std::vector<std::pair<int, int>> results;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT file_id, frequency FROM token_files "
+      "WHERE token_id = ? AND file_id BETWEEN ? AND ? ORDER BY file_id;");
+  if (!stmt) {
+    return results;
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1, tokenId);
+  sqlite3_bind_int(stmt.get(), 2, firstFileId);
+  sqlite3_bind_int(stmt.get(), 3, lastFileId);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    results.emplace_back(sqlite3_column_int(stmt.get(), 0),
+                         sqlite3_column_int(stmt.get(), 1));
+  }
+
+  return results;
+}
+
+std::vector<ScoreBlock> Database::getScoreBlocks(int64_t tokenId) const {
+  std::vector<ScoreBlock> blocks;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT last_file_id, max_frequency FROM token_blocks "
+      "WHERE token_id = ? ORDER BY last_file_id;");
+  if (!stmt) {
+    return blocks;
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1, tokenId);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    blocks.push_back({sqlite3_column_int(stmt.get(), 0),
+                      sqlite3_column_int(stmt.get(), 1)});
+  }
+
+  return blocks;
+}
+
+bool Database::hasStaleScoreBounds() const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT EXISTS (SELECT 1 FROM stale_bounds);");
+  if (!stmt) {
+    return true;
+  }
+
+  bool stale = true;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    stale = sqlite3_column_int(stmt.get(), 0) != 0;
+  }
+
+  return stale;
+}
+
+std::vector<std::pair<std::string, size_t>>
+Database::getFrequentTokens(size_t limit) const {
+  std::vector<std::pair<std::string, size_t>> tokens;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(R"(
+    SELECT t.token, COUNT(*) AS files
+    FROM token_files tf
+    JOIN tokens t ON tf.token_id = t.id
+    GROUP BY tf.token_id
+    ORDER BY files DESC
+    LIMIT ?;
+  )");
+  if (!stmt) {
+    return tokens;
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(limit));
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const char *token =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+    auto files = static_cast<size_t>(sqlite3_column_int64(stmt.get(), 1));
+    tokens.emplace_back(token ? token : "", files);
+  }
+
+  return tokens;
+}
+
+size_t Database::refreshScoreBounds() {
+  std::vector<int64_t> tokenIds;
+  {
+    auto stmt = writer_->prepare("SELECT token_id FROM stale_bounds;");
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      tokenIds.push_back(sqlite3_column_int64(stmt.get(), 0));
+    }
+  }
+
+  if (tokenIds.empty()) {
+    return 0;
+  }
+
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    auto clear =
+        writer_->prepare("DELETE FROM token_blocks WHERE token_id = ?;");
+    auto scan = writer_->prepare(
+        "SELECT file_id, frequency FROM token_files "
+        "WHERE token_id = ? ORDER BY file_id;");
+    auto insert = writer_->prepare(
+        "INSERT INTO token_blocks (token_id, last_file_id, max_frequency) "
+        "VALUES (?, ?, ?);");
+    if (!clear || !scan || !insert) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    auto emitBlock = [&](int64_t tokenId, int lastFileId, int maxFrequency) {
+      sqlite3_bind_int64(insert.get(), 1, tokenId);
+      sqlite3_bind_int(insert.get(), 2, lastFileId);
+      sqlite3_bind_int(insert.get(), 3, maxFrequency);
+      if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(insert.get());
+    };
+
+    for (int64_t tokenId : tokenIds) {
+      sqlite3_bind_int64(clear.get(), 1, tokenId);
+      if (sqlite3_step(clear.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(clear.get());
+
+      sqlite3_bind_int64(scan.get(), 1, tokenId);
+      int count = 0;
+      int lastFileId = 0;
+      int maxFrequency = 0;
+      while (sqlite3_step(scan.get()) == SQLITE_ROW) {
+        lastFileId = sqlite3_column_int(scan.get(), 0);
+        maxFrequency =
+            std::max(maxFrequency, sqlite3_column_int(scan.get(), 1));
+        if (++count == SCORE_BLOCK_SIZE) {
+          emitBlock(tokenId, lastFileId, maxFrequency);
+          count = 0;
+          maxFrequency = 0;
+        }
+      }
+      sqlite3_reset(scan.get());
+      if (count > 0) {
+        emitBlock(tokenId, lastFileId, maxFrequency);
+      }
+    }
+
+    executeSQL("DELETE FROM stale_bounds;");
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+
+  return tokenIds.size();
+}
+
+bool Database::isFileModified(const std::string &path,
+                              std::filesystem::file_time_type modTime) const {
+  ReaderLease reader(*this);
+  auto stmt =
+      reader->prepare("SELECT modified_time FROM files WHERE path = ?;");
+  if (!stmt) {
+    return true;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, path.c_str(), -1, SQLITE_STATIC);
+
+  bool modified = true;
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    int64_t storedTime = sqlite3_column_int64(stmt.get(), 0);
+    int64_t currentTime = modTime.time_since_epoch().count();
+    modified = (storedTime != currentTime);
+  }
+
+  return modified;
+}
+
+void Database::deleteFileTokens(int fileId) {
+  for (const char *sql : {"DELETE FROM token_files WHERE file_id = ?;",
+                          "DELETE FROM trigram_files WHERE file_id = ?;",
+                          "DELETE FROM streamed_files WHERE file_id = ?;"}) {
+    auto stmt = writer_->prepare(sql);
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    sqlite3_bind_int(stmt.get(), 1, fileId);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
+}
+
+void Database::putContentTrigrams(const std::vector<uint64_t> &rows,
+                                  const std::vector<int> &fileIds) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    auto insert = writer_->prepare("INSERT OR IGNORE INTO content_trigrams "
+                                   "(trigram, file_id) VALUES (?, ?);");
+    auto cover = writer_->prepare(
+        "INSERT OR IGNORE INTO trigram_files (file_id) VALUES (?);");
+    if (!insert || !cover) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    for (uint64_t row : rows) {
+      sqlite3_bind_int(insert.get(), 1, static_cast<int>(row >> 32));
+      sqlite3_bind_int(insert.get(), 2, static_cast<int>(row & 0xffffffff));
+      if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(insert.get());
+    }
+
+    for (int fileId : fileIds) {
+      sqlite3_bind_int(cover.get(), 1, fileId);
+      if (sqlite3_step(cover.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(cover.get());
+    }
+
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+}
+
+std::vector<int> Database::getContentTrigramFiles(uint32_t trigram) const {
+  std::vector<int> fileIds;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT file_id FROM content_trigrams "
+                              "WHERE trigram = ? ORDER BY file_id;");
+  if (!stmt) {
+    return fileIds;
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, static_cast<int>(trigram));
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    fileIds.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return fileIds;
+}
+
+std::vector<int> Database::getTrigramCoveredFiles() const {
+  std::vector<int> fileIds;
+
+  ReaderLease reader(*this);
+  auto stmt =
+      reader->prepare("SELECT file_id FROM trigram_files ORDER BY file_id;");
+  if (!stmt) {
+    return fileIds;
+  }
+
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    fileIds.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return fileIds;
+}
+
+void Database::markStreamed(int fileId) {
+  auto stmt = writer_->prepare(
+      "INSERT OR IGNORE INTO streamed_files (file_id) VALUES (?);");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+}
+
+// Streamed files keep only their first chunk in the document store, so
+// phrase checks must read them from disk.
+bool Database::isStreamed(int fileId) const {
+  ReaderLease reader(*this);
+  {
+    auto stmt =
+        reader->prepare("SELECT 1 FROM streamed_files WHERE file_id = ?;");
+    if (stmt) {
+      sqlite3_bind_int(stmt.get(), 1, fileId);
+      return sqlite3_step(stmt.get()) == SQLITE_ROW;
+    }
+  }
+
+  // Indexes older than schema v10 streamed every file above the default
+  // size limit.
+  auto stmt =
+      reader->prepare("SELECT 1 FROM files WHERE id = ? AND size > ?;");
+  if (!stmt) {
+    return false;
+  }
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  sqlite3_bind_int64(stmt.get(), 2,
+                     static_cast<int64_t>(TextExtractor::MAX_FILE_SIZE));
+  return sqlite3_step(stmt.get()) == SQLITE_ROW;
+}
+
+std::vector<int> Database::getFilesWithoutTrigrams() const {
+  std::vector<int> fileIds;
+
+  // Indexes older than schema v8 have no coverage table; every owner is
+  // then unindexed.
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      tableExists(*reader, "trigram_files")
+          ? "SELECT f.id FROM files f WHERE EXISTS "
+            "(SELECT 1 FROM token_files tf WHERE tf.file_id = f.id) "
+            "AND NOT EXISTS "
+            "(SELECT 1 FROM trigram_files t WHERE t.file_id = f.id) "
+            "ORDER BY f.id;"
+          : "SELECT DISTINCT file_id FROM token_files ORDER BY file_id;");
+  if (!stmt) {
+    return fileIds;
+  }
+
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    fileIds.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return fileIds;
+}
+
+std::vector<int> Database::getIndexedFiles() const {
+  std::vector<int> fileIds;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT f.id FROM files f WHERE EXISTS "
+      "(SELECT 1 FROM token_files tf WHERE tf.file_id = f.id) ORDER BY f.id;");
+  if (!stmt) {
+    return fileIds;
+  }
+
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    fileIds.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return fileIds;
+}
+
+// With replaceAll, documents missing from locations lose their row.
+void Database::putDocumentLocations(
+    const std::vector<std::pair<int, DocumentLocation>> &locations,
+    bool replaceAll) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    if (replaceAll) {
+      executeSQL("DELETE FROM documents;");
+    }
+
+    auto stmt = writer_->prepare(
+        "INSERT OR REPLACE INTO documents "
+        "(file_id, block_offset, doc_offset, doc_length) VALUES (?, ?, ?, ?);");
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    for (const auto &[fileId, location] : locations) {
+      sqlite3_bind_int(stmt.get(), 1, fileId);
+      sqlite3_bind_int64(stmt.get(), 2,
+                         static_cast<sqlite3_int64>(location.blockOffset));
+      sqlite3_bind_int64(stmt.get(), 3, location.docOffset);
+      sqlite3_bind_int64(stmt.get(), 4, location.docLength);
+      if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(stmt.get());
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+}
+
+std::optional<DocumentLocation>
+Database::getDocumentLocation(int fileId) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT block_offset, doc_offset, doc_length "
+                              "FROM documents WHERE file_id = ?;");
+  if (!stmt) {
+    return std::nullopt;
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return std::nullopt;
+  }
+
+  DocumentLocation location;
+  location.blockOffset =
+      static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 0));
+  location.docOffset = static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 1));
+  location.docLength = static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 2));
+  return location;
+}
+
+std::vector<std::pair<int, DocumentLocation>>
+Database::getDocumentLocations() const {
+  std::vector<std::pair<int, DocumentLocation>> locations;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT file_id, block_offset, doc_offset, doc_length FROM documents "
+      "ORDER BY block_offset, doc_offset;");
+  if (!stmt) {
+    return locations;
+  }
+
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    DocumentLocation location;
+    location.blockOffset =
+        static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 1));
+    location.docOffset =
+        static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 2));
+    location.docLength =
+        static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 3));
+    locations.emplace_back(sqlite3_column_int(stmt.get(), 0), location);
+  }
+
+  return locations;
+}
+
+void Database::deleteDocument(int fileId) {
+  auto stmt = writer_->prepare("DELETE FROM documents WHERE file_id = ?;");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+}
+
+std::optional<bool>
+Database::getContentClass(const FileIdentity &identity) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT modified_time, is_text "
+                               "FROM content_classes "
+                               "WHERE device = ? AND inode = ?;");
+  if (!stmt) {
+    return std::nullopt;
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1,
+                     static_cast<sqlite3_int64>(identity.device));
+  sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(identity.inode));
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW ||
+      sqlite3_column_int64(stmt.get(), 0) != identity.modifiedTime) {
+    return std::nullopt;
+  }
+
+  return sqlite3_column_int(stmt.get(), 1) != 0;
+}
+
+void Database::putContentClasses(
+    const std::vector<std::pair<FileIdentity, bool>> &classes) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    auto stmt = writer_->prepare(
+        "INSERT OR REPLACE INTO content_classes "
+        "(device, inode, modified_time, is_text) VALUES (?, ?, ?, ?);");
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+
+    for (const auto &[identity, isText] : classes) {
+      sqlite3_bind_int64(stmt.get(), 1,
+                         static_cast<sqlite3_int64>(identity.device));
+      sqlite3_bind_int64(stmt.get(), 2,
+                         static_cast<sqlite3_int64>(identity.inode));
+      sqlite3_bind_int64(stmt.get(), 3, identity.modifiedTime);
+      sqlite3_bind_int(stmt.get(), 4, isText ? 1 : 0);
+      if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_reset(stmt.get());
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    throw;
+  }
+}
+
+std::optional<FileRecord> Database::getFileRecord(const std::string &path) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare("SELECT id, size, modified_time, content_hash "
+                               "FROM files WHERE path = ?;");
+  if (!stmt) {
+    return std::nullopt;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, path.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return std::nullopt;
+  }
+
+  FileRecord record;
+  record.id = sqlite3_column_int(stmt.get(), 0);
+  record.size = static_cast<std::uintmax_t>(sqlite3_column_int64(stmt.get(), 1));
+  record.modifiedTime = sqlite3_column_int64(stmt.get(), 2);
+  if (sqlite3_column_type(stmt.get(), 3) != SQLITE_NULL) {
+    record.contentHash =
+        static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 3));
+  }
+  return record;
+}
+
+void Database::setContentHash(int fileId, uint64_t contentHash) {
+  auto stmt =
+      writer_->prepare("UPDATE files SET content_hash = ? WHERE id = ?;");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(contentHash));
+  sqlite3_bind_int(stmt.get(), 2, fileId);
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+}
+
+int Database::findContentOwner(uint64_t contentHash, int excludeFileId) const {
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT f.id FROM files f "
+      "WHERE f.content_hash = ? AND f.id != ? "
+      "AND EXISTS (SELECT 1 FROM token_files tf WHERE tf.file_id = f.id) "
+      "LIMIT 1;");
+  if (!stmt) {
+    return -1;
+  }
+
+  sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(contentHash));
+  sqlite3_bind_int(stmt.get(), 2, excludeFileId);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return -1;
+  }
+  return sqlite3_column_int(stmt.get(), 0);
+}
+
+void Database::releaseFileContent(int fileId) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    releaseContent(fileId);
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    releasedTokens_.clear();
+    throw;
+  }
+  invalidateReleasedTokens();
+}
+
+// Forgets a file that is no longer indexed, handing its content to another
+// path with the same hash if there is one.
+void Database::deleteFile(int fileId) {
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    releaseContent(fileId);
+    for (const char *sql : {"DELETE FROM path_trigrams WHERE file_id = ?;",
+                            "DELETE FROM streamed_files WHERE file_id = ?;",
+                            "DELETE FROM files WHERE id = ?;"}) {
+      auto stmt = writer_->prepare(sql);
+      if (!stmt) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+      sqlite3_bind_int(stmt.get(), 1, fileId);
+      if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("SQL error: ") +
+                                 sqlite3_errmsg(db_));
+      }
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    releasedTokens_.clear();
+    throw;
+  }
+  invalidateReleasedTokens();
+}
+
+// Moves the rows stored under the directory spelled `from` to `to`. Earlier
+// crawls stored paths as the root was typed, so re-crawling the same
+// directory under its canonical path would otherwise index every file twice.
+// A row whose new path is already indexed gives up its content instead.
+size_t Database::renamePaths(const std::string &from, const std::string &to) {
+  std::vector<std::pair<int, std::string>> rows;
+  {
+    auto stmt = writer_->prepare(
+        "SELECT id, path FROM files WHERE path = ?1 "
+        "OR substr(path, 1, length(?1) + 1) = ?1 || '/';");
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_text(stmt.get(), 1, from.c_str(), -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      rows.emplace_back(
+          sqlite3_column_int(stmt.get(), 0),
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1)));
+    }
+  }
+  if (rows.empty()) {
+    return 0;
+  }
+
+  auto run = [this](const char *sql, int fileId, const std::string *path) {
+    auto stmt = writer_->prepare(sql);
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    int index = 1;
+    if (path) {
+      sqlite3_bind_text(stmt.get(), index++, path->c_str(), -1,
+                        SQLITE_STATIC);
+    }
+    sqlite3_bind_int(stmt.get(), index, fileId);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  };
+
+  executeSQL("BEGIN TRANSACTION;");
+
+  try {
+    for (const auto &[fileId, oldPath] : rows) {
+      std::string newPath = to + oldPath.substr(from.size());
+      run("DELETE FROM path_trigrams WHERE file_id = ?;", fileId, nullptr);
+
+      bool taken = false;
+      {
+        auto stmt = writer_->prepare("SELECT 1 FROM files WHERE path = ?;");
+        if (!stmt) {
+          throw std::runtime_error(std::string("SQL error: ") +
+                                   sqlite3_errmsg(db_));
+        }
+        sqlite3_bind_text(stmt.get(), 1, newPath.c_str(), -1, SQLITE_STATIC);
+        taken = sqlite3_step(stmt.get()) == SQLITE_ROW;
+      }
+
+      if (taken) {
+        releaseContent(fileId);
+        run("DELETE FROM files WHERE id = ?;", fileId, nullptr);
+      } else {
+        run("UPDATE files SET path = ? WHERE id = ?;", fileId, &newPath);
+        insertPathTrigrams(fileId, newPath);
+      }
+    }
+    executeSQL("COMMIT;");
+  } catch (...) {
+    executeSQL("ROLLBACK;");
+    releasedTokens_.clear();
+    throw;
+  }
+  invalidateReleasedTokens();
+  return rows.size();
+}
+
+// Records the tokens whose postings lose or change this file. They are
+// invalidated only after the commit: a query that cached the old postings
+// before then would otherwise outlive the invalidation.
+void Database::collectReleasedTokens(int fileId) {
+  if (!options_.postingsCache) {
+    return;
+  }
+
+  auto stmt = writer_->prepare(
+      "SELECT t.token FROM token_files tf "
+      "JOIN tokens t ON t.id = tf.token_id WHERE tf.file_id = ?;");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(db_));
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    releasedTokens_.emplace_back(
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0)));
+  }
+}
+
+void Database::invalidateReleasedTokens() {
+  if (options_.postingsCache) {
+    for (const auto &token : releasedTokens_) {
+      options_.postingsCache->invalidate(token);
+    }
+  }
+  releasedTokens_.clear();
+}
+
+void Database::releaseContent(int fileId) {
+  if (!hasFileTokens(*writer_, fileId)) {
+    deleteDocument(fileId);
+    return;
+  }
+
+  int heir = -1;
+  {
+    auto stmt = writer_->prepare(
+        "SELECT other.id FROM files self "
+        "JOIN files other ON other.content_hash = self.content_hash "
+        "WHERE self.id = ? AND other.id != self.id LIMIT 1;");
+    if (stmt) {
+      sqlite3_bind_int(stmt.get(), 1, fileId);
+      if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        heir = sqlite3_column_int(stmt.get(), 0);
+      }
+    }
+  }
+
+  collectReleasedTokens(fileId);
+  if (heir == -1) {
+    deleteFileTokens(fileId);
+    deleteDocument(fileId);
+    return;
+  }
+
+  {
+    auto stale = writer_->prepare(
+        "INSERT OR IGNORE INTO stale_bounds (token_id) "
+        "SELECT token_id FROM token_files WHERE file_id = ?;");
+    if (!stale) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_int(stale.get(), 1, fileId);
+    if (sqlite3_step(stale.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
+
+  for (const char *sql :
+       {"UPDATE token_files SET file_id = ? WHERE file_id = ?;",
+        "UPDATE documents SET file_id = ? WHERE file_id = ?;",
+        "UPDATE streamed_files SET file_id = ? WHERE file_id = ?;"}) {
+    auto stmt = writer_->prepare(sql);
+    if (!stmt) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+    sqlite3_bind_int(stmt.get(), 1, heir);
+    sqlite3_bind_int(stmt.get(), 2, fileId);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("SQL error: ") +
+                               sqlite3_errmsg(db_));
+    }
+  }
+}
+
+std::vector<std::pair<int, std::string>>
+Database::getFilesWithSameContent(int fileId,
+                                  const std::string &extension) const {
+  std::vector<std::pair<int, std::string>> files;
+  std::string suffix = extension.empty() ? "" : "." + extension;
+
+  // An extension keeps the paths getDocumentsWithExtension matches.
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(
+      "SELECT id, path FROM files WHERE id = ?1 "
+      "AND (?2 = '' OR lower(extension) = ?2) "
+      "UNION "
+      "SELECT id, path FROM files WHERE content_hash = "
+      "(SELECT content_hash FROM files WHERE id = ?1) "
+      "AND (?2 = '' OR lower(extension) = ?2);");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") +
+                             sqlite3_errmsg(reader->handle));
+  }
+
+  sqlite3_bind_int(stmt.get(), 1, fileId);
+  sqlite3_bind_text(stmt.get(), 2, suffix.c_str(), -1, SQLITE_STATIC);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const char *path =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+    files.emplace_back(sqlite3_column_int(stmt.get(), 0), path ? path : "");
+  }
+
+  return files;
+}
+
+// Paths under prefix that show the content of any of fileIds, counting the
+// files themselves and every copy that shares their content.
+size_t Database::countPathsWithContent(const std::vector<int> &fileIds,
+                                       const std::string &prefix) const {
+  if (fileIds.empty()) {
+    return 0;
+  }
+
+  std::string ids = "[";
+  for (int fileId : fileIds) {
+    if (ids.size() > 1) {
+      ids += ',';
+    }
+    ids += std::to_string(fileId);
+  }
+  ids += ']';
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(R"(
+    SELECT COUNT(*) FROM files
+    WHERE id IN (
+      SELECT value FROM json_each(?1)
+      UNION
+      SELECT f.id FROM json_each(?1) j
+      JOIN files o ON o.id = j.value
+      JOIN files f ON f.content_hash = o.content_hash
+    ) AND substr(path, 1, length(?2)) = ?2;
+  )");
+  if (!stmt) {
+    throw std::runtime_error(std::string("SQL error: ") +
+                             sqlite3_errmsg(reader->handle));
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, ids.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt.get(), 2, prefix.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    throw std::runtime_error(std::string("SQL error: ") +
+                             sqlite3_errmsg(reader->handle));
+  }
+  return static_cast<size_t>(sqlite3_column_int64(stmt.get(), 0));
+}
+
+std::vector<int> Database::getDocumentsUnder(const std::string &prefix) const {
+  std::vector<int> documents;
+  if (prefix.empty()) {
+    return documents;
+  }
+
+  std::string high = prefix;
+  high.back()++;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(R"(
+    SELECT f.id FROM files f
+    WHERE f.path >= ?1 AND f.path < ?2
+      AND EXISTS (SELECT 1 FROM token_files tf WHERE tf.file_id = f.id)
+    UNION
+    SELECT o.id FROM files f
+    JOIN files o ON o.content_hash = f.content_hash AND o.id != f.id
+    WHERE f.path >= ?1 AND f.path < ?2
+      AND EXISTS (SELECT 1 FROM token_files tf WHERE tf.file_id = o.id)
+    ORDER BY 1;
+  )");
+  if (!stmt) {
+    return documents;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, prefix.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt.get(), 2, high.c_str(), -1, SQLITE_STATIC);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    documents.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return documents;
+}
+
+std::vector<int>
+Database::getDocumentsWithExtension(const std::string &extension) const {
+  std::vector<int> documents;
+  std::string suffix = "." + extension;
+
+  ReaderLease reader(*this);
+  auto stmt = reader->prepare(R"(
+    SELECT f.id FROM files f
+    WHERE lower(f.extension) = ?1
+      AND EXISTS (SELECT 1 FROM token_files tf WHERE tf.file_id = f.id)
+    UNION
+    SELECT o.id FROM files f
+    JOIN files o ON o.content_hash = f.content_hash AND o.id != f.id
+    WHERE lower(f.extension) = ?1
+      AND EXISTS (SELECT 1 FROM token_files tf WHERE tf.file_id = o.id)
+    ORDER BY 1;
+  )");
+  if (!stmt) {
+    return documents;
+  }
+
+  sqlite3_bind_text(stmt.get(), 1, suffix.c_str(), -1, SQLITE_STATIC);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    documents.push_back(sqlite3_column_int(stmt.get(), 0));
+  }
+
+  return documents;
+}
+
+std::vector<std::string> Database::findPaths(const std::string &substring,
+                                             size_t limit) const {
+  std::vector<std::string> paths;
+  std::string needle = foldPath(substring);
+  if (needle.empty()) {
+    return paths;
+  }
+
+  ReaderLease reader(*this);
+
+  auto matches = [&](const char *path) {
+    return path && foldPath(path).find(needle) != std::string::npos;
+  };
+
+  std::vector<uint32_t> trigrams = extractTrigrams(needle);
+  if (trigrams.empty()) {
+    auto stmt = reader->prepare(
+        "SELECT path FROM files WHERE instr(lower(path), ?) > 0 ORDER BY id;");
+    if (!stmt) {
+      return paths;
+    }
+    sqlite3_bind_text(stmt.get(), 1, needle.c_str(), -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW &&
+           (limit == 0 || paths.size() < limit)) {
+      const char *path =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+      if (matches(path)) {
+        paths.emplace_back(path);
+      }
+    }
+    return paths;
+  }
+
+  std::vector<std::pair<size_t, uint32_t>> ordered;
+  {
+    auto count = reader->prepare(
+        "SELECT COUNT(*) FROM (SELECT 1 FROM path_trigrams "
+        "WHERE trigram = ? LIMIT ?);");
+    if (!count) {
+      return paths;
+    }
+    for (uint32_t trigram : trigrams) {
+      sqlite3_bind_int(count.get(), 1, static_cast<int>(trigram));
+      sqlite3_bind_int(count.get(), 2, TRIGRAM_COUNT_LIMIT);
+      size_t rows = 0;
+      if (sqlite3_step(count.get()) == SQLITE_ROW) {
+        rows = static_cast<size_t>(sqlite3_column_int64(count.get(), 0));
+      }
+      sqlite3_reset(count.get());
+      if (rows == 0) {
+        return paths;
+      }
+      ordered.emplace_back(rows, trigram);
+    }
+  }
+  std::sort(ordered.begin(), ordered.end());
+
+  auto list = reader->prepare(
+      "SELECT file_id FROM path_trigrams WHERE trigram = ? ORDER BY file_id;");
+  auto probe = reader->prepare(
+      "SELECT 1 FROM path_trigrams WHERE trigram = ? AND file_id = ?;");
+  auto lookup = reader->prepare("SELECT path FROM files WHERE id = ?;");
+  if (!list || !probe || !lookup) {
+    return paths;
+  }
+
+  auto readList = [&](uint32_t trigram) {
+    std::vector<int> ids;
+    sqlite3_bind_int(list.get(), 1, static_cast<int>(trigram));
+    while (sqlite3_step(list.get()) == SQLITE_ROW) {
+      ids.push_back(sqlite3_column_int(list.get(), 0));
+    }
+    sqlite3_reset(list.get());
+    return ids;
+  };
+
+  std::vector<int> candidates = readList(ordered.front().second);
+  for (size_t i = 1; i < ordered.size() && !candidates.empty(); ++i) {
+    auto [rows, trigram] = ordered[i];
+    std::vector<int> kept;
+    if (candidates.size() * 4 < rows) {
+      sqlite3_bind_int(probe.get(), 1, static_cast<int>(trigram));
+      for (int fileId : candidates) {
+        sqlite3_bind_int(probe.get(), 2, fileId);
+        if (sqlite3_step(probe.get()) == SQLITE_ROW) {
+          kept.push_back(fileId);
+        }
+        sqlite3_reset(probe.get());
+      }
+    } else {
+      std::vector<int> ids = readList(trigram);
+      std::set_intersection(candidates.begin(), candidates.end(), ids.begin(),
+                            ids.end(), std::back_inserter(kept));
+    }
+    candidates = std::move(kept);
+  }
+
+  for (int fileId : candidates) {
+    if (limit > 0 && paths.size() >= limit) {
+      break;
+    }
+    sqlite3_bind_int(lookup.get(), 1, fileId);
+    if (sqlite3_step(lookup.get()) == SQLITE_ROW) {
+      const char *path =
+          reinterpret_cast<const char *>(sqlite3_column_text(lookup.get(), 0));
+      if (matches(path)) {
+        paths.emplace_back(path);
+      }
+    }
+    sqlite3_reset(lookup.get());
+  }
+
+  return paths;
+}
+
+StorageStats Database::getStorageStats(bool measureFragmentation) const {
+  StorageStats stats;
+  ReaderLease reader(*this);
+  stats.pageSize = queryPragma(*reader, "PRAGMA page_size;");
+  stats.pageCount = queryPragma(*reader, "PRAGMA page_count;");
+  stats.freePages = queryPragma(*reader, "PRAGMA freelist_count;");
+  stats.incrementalVacuum = queryPragma(*reader, "PRAGMA auto_vacuum;") == 2;
+  if (!measureFragmentation) {
+    return stats;
+  }
+
+  auto stmt = reader->prepare(
+      "SELECT name, pageno FROM dbstat WHERE pagetype = 'leaf';");
+  if (!stmt) {
+    return stats;
+  }
+
+  // dbstat walks each b-tree in key order, so a leaf that does not follow
+  // its predecessor on disk costs a seek on a sequential scan.
+  std::string previousName;
+  int64_t previousPage = -1;
+  size_t leaves = 0;
+  size_t jumps = 0;
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const char *name =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+    int64_t page = sqlite3_column_int64(stmt.get(), 1);
+    if (name && previousName == name) {
+      if (page != previousPage + 1) {
+        jumps++;
+      }
+    } else {
+      previousName = name ? name : "";
+    }
+    previousPage = page;
+    leaves++;
+  }
+
+  if (leaves > 0) {
+    stats.fragmentation = static_cast<double>(jumps) / leaves;
+  }
+  return stats;
+}
+
+MaintenanceStats
+Database::optimizeDatabase(const MaintenanceOptions &options) {
+  auto start = std::chrono::steady_clock::now();
+  MaintenanceStats stats;
+
+  executeSQL("PRAGMA analysis_limit=400;");
+  executeSQL("ANALYZE;");
+
+  auto storage = getStorageStats();
+  if (storage.incrementalVacuum && storage.freePages > 0 &&
+      storage.freeRatio() >= options.minFreeRatio) {
+    std::string step = "PRAGMA incremental_vacuum(" +
+                       std::to_string(std::max(options.pagesPerStep, 1)) +
+                       ");";
+    int64_t freePages = storage.freePages;
+
+    while (freePages > 0 && !(options.cancelled && options.cancelled())) {
+      auto stepStart = std::chrono::steady_clock::now();
+      executeSQL(step.c_str());
+      int64_t remaining = queryPragma(*writer_, "PRAGMA freelist_count;");
+      int64_t reclaimed = freePages - remaining;
+      freePages = remaining;
+      stats.steps++;
+      if (reclaimed <= 0) {
+        break;
+      }
+      stats.pagesReclaimed += reclaimed;
+
+      if (options.ioBytesPerSecond == 0) {
+        continue;
+      }
+      // Each reclaimed page may relocate a live page: one read, one write.
+      std::chrono::duration<double> budget(
+          2.0 * static_cast<double>(reclaimed * storage.pageSize) /
+          static_cast<double>(options.ioBytesPerSecond));
+      auto spent = std::chrono::steady_clock::now() - stepStart;
+      if (budget > spent) {
+        auto pause =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                budget - spent);
+        std::this_thread::sleep_for(pause);
+        stats.throttled += pause;
+      }
+    }
+  }
+
+  stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  return stats;
+}
+
+void Database::vacuum() {
+  executeSQL("VACUUM;");
+}
+
+bool Database::hasFileTokens(int fileId) const {
+  ReaderLease reader(*this);
+  return hasFileTokens(*reader, fileId);
+}
+
+// Inside a write transaction only the writer sees its own changes.
+bool Database::hasFileTokens(Connection &conn, int fileId) const {
+  auto stmt = conn.prepare(
+      "SELECT EXISTS (SELECT 1 FROM token_files WHERE file_id = ?);");
+  if (!stmt) {
     return false;
   }
 
-  sqlite3_bind_int(stmt, 1, fileId);
+  sqlite3_bind_int(stmt.get(), 1, fileId);
 
   bool hasTokens = false;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    int count = sqlite3_column_int(stmt, 0);
-    hasTokens = (count > 0);
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    hasTokens = sqlite3_column_int(stmt.get(), 0) != 0;
   }
 
-  sqlite3_finalize(stmt);
   return hasTokens;
 }
 
@@ -0,0 +1,428 @@
+#include "glint/document_store.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifdef GLINT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace glint {
+
+namespace {
+
+enum BlockCodec : uint8_t { CODEC_NONE = 0, CODEC_ZLIB = 1 };
+
+constexpr size_t BLOCK_HEADER_SIZE = 9;
+
+void storeU32(char *out, uint32_t value) {
+  std::memcpy(out, &value, sizeof(value));
+}
+
+uint32_t loadU32(const char *in) {
+  uint32_t value = 0;
+  std::memcpy(&value, in, sizeof(value));
+  return value;
+}
+
+// Header and payload of one block, compressed when that saves space.
+std::string encodeBlock(const std::string &raw) {
+  std::string stored;
+  uint8_t codec = CODEC_NONE;
+#ifdef GLINT_HAVE_ZLIB
+  uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+  stored.resize(compressedSize);
+  if (compress2(reinterpret_cast<Bytef *>(stored.data()), &compressedSize,
+                reinterpret_cast<const Bytef *>(raw.data()),
+                static_cast<uLong>(raw.size()), Z_BEST_SPEED) == Z_OK &&
+      compressedSize < raw.size()) {
+    stored.resize(compressedSize);
+    codec = CODEC_ZLIB;
+  } else {
+    stored = raw;
+  }
+#else
+  stored = raw;
+#endif
+
+  char header[BLOCK_HEADER_SIZE];
+  header[0] = static_cast<char>(codec);
+  storeU32(header + 1, static_cast<uint32_t>(raw.size()));
+  storeU32(header + 5, static_cast<uint32_t>(stored.size()));
+  return std::string(header, sizeof(header)) + stored;
+}
+
+} // namespace
+
+struct DocumentStore::Mapping {
+  const char *data = nullptr;
+  std::uint64_t size = 0;
+#ifdef _WIN32
+  std::string buffer;
+#endif
+
+  explicit Mapping(const std::filesystem::path &path) {
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (in.is_open()) {
+      buffer.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+      data = buffer.data();
+      size = buffer.size();
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                          MAP_SHARED, fd, 0);
+      if (addr != MAP_FAILED) {
+        data = static_cast<const char *>(addr);
+        size = static_cast<std::uint64_t>(st.st_size);
+      }
+    }
+    ::close(fd);
+#endif
+  }
+
+  ~Mapping() {
+#ifndef _WIN32
+    if (data) {
+      ::munmap(const_cast<char *>(data), static_cast<size_t>(size));
+    }
+#endif
+  }
+
+  Mapping(const Mapping &) = delete;
+  Mapping &operator=(const Mapping &) = delete;
+};
+
+std::filesystem::path DocumentStore::pathFor(const std::string &dbPath) {
+  return std::filesystem::path(dbPath + ".docs");
+}
+
+std::string DocumentStore::normalize(std::string_view text) {
+  std::string normalized;
+  normalized.reserve(text.size());
+
+  bool pendingSpace = false;
+  for (char c : text) {
+    auto uc = static_cast<unsigned char>(c);
+    if (std::isspace(uc)) {
+      pendingSpace = !normalized.empty();
+      continue;
+    }
+    if (uc < 0x20 || uc == 0x7f) {
+      continue;
+    }
+    if (pendingSpace) {
+      normalized += ' ';
+      pendingSpace = false;
+    }
+    normalized += c;
+  }
+
+  return normalized;
+}
+
+DocumentStore::DocumentStore(Database &db, const std::filesystem::path &path,
+                             size_t blockSize)
+    : db_(db), path_(path), blockSize_(blockSize), storedBytes_(0),
+      rawBytes_(0), lockFd_(-1) {
+#ifndef _WIN32
+  auto lockPath = path_;
+  lockPath += ".lock";
+  lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lockFd_ >= 0) {
+    ::flock(lockFd_, LOCK_SH);
+  }
+#endif
+}
+
+DocumentStore::~DocumentStore() {
+  try {
+    flush();
+  } catch (...) {
+  }
+#ifndef _WIN32
+  if (lockFd_ >= 0) {
+    ::close(lockFd_);
+  }
+#endif
+}
+
+void DocumentStore::add(int fileId, std::string_view text) {
+  std::string normalized = normalize(text);
+
+  if (!pending_.empty() && pending_.size() + normalized.size() > blockSize_) {
+    flush();
+  }
+
+  DocumentLocation location;
+  location.docOffset = static_cast<uint32_t>(pending_.size());
+  location.docLength = static_cast<uint32_t>(normalized.size());
+  pending_ += normalized;
+  pendingLocations_.emplace_back(fileId, location);
+
+  if (pending_.size() >= blockSize_) {
+    flush();
+  }
+}
+
+void DocumentStore::flush() {
+  if (pendingLocations_.empty()) {
+    return;
+  }
+
+  if (!out_.is_open()) {
+    out_.open(path_, std::ios::binary | std::ios::app);
+    if (!out_.is_open()) {
+      throw std::runtime_error("Failed to open document store: " +
+                               path_.string());
+    }
+  }
+
+  std::error_code ec;
+  auto blockOffset = std::filesystem::exists(path_, ec)
+                         ? std::filesystem::file_size(path_, ec)
+                         : 0;
+
+  std::string block = encodeBlock(pending_);
+  out_.write(block.data(), static_cast<std::streamsize>(block.size()));
+  out_.flush();
+  if (!out_) {
+    throw std::runtime_error("Failed to write document store: " +
+                             path_.string());
+  }
+
+  for (auto &[fileId, location] : pendingLocations_) {
+    location.blockOffset = blockOffset;
+  }
+  db_.putDocumentLocations(pendingLocations_);
+
+  rawBytes_ += pending_.size();
+  storedBytes_ += block.size();
+  pending_.clear();
+  pendingLocations_.clear();
+}
+
+std::shared_ptr<const DocumentStore::Mapping>
+DocumentStore::mappingFor(std::uint64_t end) const {
+  std::lock_guard<std::mutex> lock(mappingMutex_);
+  if (!mapping_ || mapping_->size < end) {
+    mapping_ = std::make_shared<const Mapping>(path_);
+  }
+  if (!mapping_->data || mapping_->size < end) {
+    return nullptr;
+  }
+  return mapping_;
+}
+
+std::string DocumentStore::read(int fileId) const {
+  auto location = db_.getDocumentLocation(fileId);
+  if (!location) {
+    return "";
+  }
+
+  size_t end = static_cast<size_t>(location->docOffset) + location->docLength;
+  std::string prefix = decode(location->blockOffset, end);
+  if (prefix.size() != end) {
+    return "";
+  }
+  return prefix.substr(location->docOffset);
+}
+
+// The first length bytes of a block's text, or the whole block when it is
+// shorter. Returns an empty string when the block cannot be read.
+std::string DocumentStore::decode(std::uint64_t blockOffset,
+                                  size_t length) const {
+  auto mapping = mappingFor(blockOffset + BLOCK_HEADER_SIZE);
+  if (!mapping) {
+    return "";
+  }
+
+  const char *header = mapping->data + blockOffset;
+  auto codec = static_cast<uint8_t>(header[0]);
+  uint32_t rawSize = loadU32(header + 1);
+  uint32_t storedSize = loadU32(header + 5);
+  length = std::min<size_t>(length, rawSize);
+
+  mapping = mappingFor(blockOffset + BLOCK_HEADER_SIZE + storedSize);
+  if (!mapping) {
+    return "";
+  }
+  const char *stored = mapping->data + blockOffset + BLOCK_HEADER_SIZE;
+
+  if (codec == CODEC_NONE) {
+    return std::string(stored, std::min<size_t>(length, storedSize));
+  }
+
+#ifdef GLINT_HAVE_ZLIB
+  if (codec == CODEC_ZLIB) {
+    std::string prefix(length, '\0');
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+      return "";
+    }
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(stored));
+    stream.avail_in = storedSize;
+    stream.next_out = reinterpret_cast<Bytef *>(prefix.data());
+    stream.avail_out = static_cast<uInt>(prefix.size());
+
+    int rc = Z_OK;
+    while (stream.avail_out > 0 && rc == Z_OK) {
+      rc = inflate(&stream, Z_SYNC_FLUSH);
+    }
+    inflateEnd(&stream);
+
+    if (stream.avail_out != 0) {
+      return "";
+    }
+    return prefix;
+  }
+#endif
+
+  return "";
+}
+
+DocumentStoreStats DocumentStore::getStats() const {
+  DocumentStoreStats stats;
+
+  std::error_code ec;
+  stats.fileBytes = std::filesystem::file_size(path_, ec);
+  if (ec) {
+    stats.fileBytes = 0;
+  }
+
+  auto mapping = mappingFor(stats.fileBytes);
+  for (std::uint64_t offset = 0;
+       mapping && offset + BLOCK_HEADER_SIZE <= mapping->size;) {
+    const char *header = mapping->data + offset;
+    stats.rawBytes += loadU32(header + 1);
+    offset += BLOCK_HEADER_SIZE + loadU32(header + 5);
+  }
+
+  for (const auto &[fileId, location] : db_.getDocumentLocations()) {
+    stats.liveBytes += location.docLength;
+    stats.documents++;
+  }
+  return stats;
+}
+
+// Rewrites the live documents into a fresh file in their current order.
+// Returns nullopt without touching the store when another process has it
+// open: a crawl could be appending to it and searches map the old file.
+// The new locations replace every row in one transaction, so documents that
+// could not be read are dropped rather than left pointing into the new
+// file. A crash between that commit and the rename can leave previews
+// wrong until the files are re-indexed; search results never depend on
+// this file.
+std::optional<std::uintmax_t> DocumentStore::compact() {
+#ifndef _WIN32
+  if (lockFd_ < 0 || ::flock(lockFd_, LOCK_EX | LOCK_NB) != 0) {
+    return std::nullopt;
+  }
+  struct Relock {
+    int fd;
+    ~Relock() { ::flock(fd, LOCK_SH); }
+  } relock{lockFd_};
+#endif
+
+  flush();
+  if (out_.is_open()) {
+    out_.close();
+  }
+
+  std::error_code ec;
+  std::uintmax_t before = std::filesystem::file_size(path_, ec);
+  if (ec) {
+    return 0;
+  }
+
+  auto compactPath = path_;
+  compactPath += ".compact";
+  std::ofstream out(compactPath, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Failed to open document store: " +
+                             compactPath.string());
+  }
+
+  std::vector<std::pair<int, DocumentLocation>> moved;
+  std::vector<std::pair<int, DocumentLocation>> blockLocations;
+  std::string raw;
+  std::uint64_t written = 0;
+
+  auto writeBlock = [&] {
+    if (blockLocations.empty()) {
+      return;
+    }
+    std::string block = encodeBlock(raw);
+    out.write(block.data(), static_cast<std::streamsize>(block.size()));
+    for (auto &[fileId, location] : blockLocations) {
+      location.blockOffset = written;
+      moved.emplace_back(fileId, location);
+    }
+    written += block.size();
+    raw.clear();
+    blockLocations.clear();
+  };
+
+  std::uint64_t sourceOffset = 0;
+  std::string source;
+  for (const auto &[fileId, location] : db_.getDocumentLocations()) {
+    if (source.empty() || sourceOffset != location.blockOffset) {
+      sourceOffset = location.blockOffset;
+      source = decode(sourceOffset, std::numeric_limits<size_t>::max());
+    }
+    if (static_cast<size_t>(location.docOffset) + location.docLength >
+        source.size()) {
+      continue;
+    }
+
+    if (!raw.empty() && raw.size() + location.docLength > blockSize_) {
+      writeBlock();
+    }
+    DocumentLocation relocated;
+    relocated.docOffset = static_cast<uint32_t>(raw.size());
+    relocated.docLength = location.docLength;
+    raw.append(source, location.docOffset, location.docLength);
+    blockLocations.emplace_back(fileId, relocated);
+    if (raw.size() >= blockSize_) {
+      writeBlock();
+    }
+  }
+  writeBlock();
+
+  out.close();
+  if (!out) {
+    std::filesystem::remove(compactPath, ec);
+    throw std::runtime_error("Failed to write document store: " +
+                             compactPath.string());
+  }
+
+  db_.putDocumentLocations(moved, true);
+  std::filesystem::rename(compactPath, path_);
+  {
+    std::lock_guard<std::mutex> lock(mappingMutex_);
+    mapping_.reset();
+  }
+
+  return before > written ? before - written : 0;
+}
+
+} // namespace glint
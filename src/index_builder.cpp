@@ -1,31 +1,532 @@
 #include "glint/index_builder.h"
-#include <map>
+#include "glint/document_store.h"
+#include "glint/memory_budget.h"
+#include "glint/postings_cache.h"
+#include "glint/trigram.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
 #include <tuple>
 
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
 namespace glint {
 
-IndexBuilder::IndexBuilder(Database &db) : db_(db) {}
+namespace {
+
+constexpr size_t TERM_OVERHEAD = 64;
+constexpr size_t TERM_BATCH = 4096;
+
+void writeU32(std::ofstream &out, uint32_t value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool readU32(std::ifstream &in, uint32_t &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+class RunReader {
+public:
+  explicit RunReader(const std::filesystem::path &path)
+      : in_(path, std::ios::binary) {
+    if (!in_.is_open()) {
+      throw std::runtime_error("Failed to open index run: " + path.string());
+    }
+  }
+
+  bool next() {
+    uint32_t termLength = 0;
+    if (!readU32(in_, termLength)) {
+      return false;
+    }
+
+    term_.resize(termLength);
+    in_.read(term_.data(), termLength);
+
+    uint32_t count = 0;
+    readU32(in_, count);
+    postings_.resize(count);
+    for (auto &[fileId, frequency] : postings_) {
+      uint32_t id = 0;
+      uint32_t freq = 0;
+      readU32(in_, id);
+      readU32(in_, freq);
+      fileId = static_cast<int>(id);
+      frequency = static_cast<int>(freq);
+    }
+
+    return static_cast<bool>(in_);
+  }
+
+  const std::string &term() const { return term_; }
+  const std::vector<std::pair<int, int>> &postings() const { return postings_; }
+
+private:
+  std::ifstream in_;
+  std::string term_;
+  std::vector<std::pair<int, int>> postings_;
+};
+
+template <typename Dictionary>
+std::vector<typename Dictionary::iterator> sortedTerms(Dictionary &dictionary) {
+  std::vector<typename Dictionary::iterator> terms;
+  terms.reserve(dictionary.size());
+  for (auto it = dictionary.begin(); it != dictionary.end(); ++it) {
+    terms.push_back(it);
+  }
+  std::sort(terms.begin(), terms.end(),
+            [](const auto &a, const auto &b) { return a->first < b->first; });
+  return terms;
+}
+
+std::filesystem::path makeRunPath(const std::filesystem::path &directory) {
+  static std::atomic<unsigned> runCounter{0};
+
+  std::string name = "glint-run-" + std::to_string(getpid()) + "-" +
+                     std::to_string(runCounter++) + ".bin";
+  return directory / name;
+}
+
+} // namespace
+
+TermCounter::TermCounter(size_t memoryBudget,
+                         std::filesystem::path spillDirectory)
+    : memoryBudget_(memoryBudget), spillDirectory_(std::move(spillDirectory)),
+      memoryUsed_(0), tokens_(0) {
+  if (spillDirectory_.empty()) {
+    spillDirectory_ = std::filesystem::temp_directory_path();
+  }
+}
+
+TermCounter::~TermCounter() {
+  for (const auto &path : runs_) {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+}
+
+void TermCounter::add(std::string &&token) {
+  tokens_++;
+  auto [it, inserted] = counts_.try_emplace(std::move(token), 0);
+  it->second++;
+  if (inserted) {
+    memoryUsed_ += it->first.size() + TERM_OVERHEAD;
+    if (memoryUsed_ >= memoryBudget_) {
+      spill();
+    }
+  }
+}
+
+// Runs use the index run format with a single posting that holds the count.
+void TermCounter::spill() {
+  if (counts_.empty()) {
+    return;
+  }
+
+  auto path = makeRunPath(spillDirectory_);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Failed to create index run: " + path.string());
+  }
+  runs_.push_back(path);
+
+  for (const auto &it : sortedTerms(counts_)) {
+    writeU32(out, static_cast<uint32_t>(it->first.size()));
+    out.write(it->first.data(), it->first.size());
+    writeU32(out, 1);
+    writeU32(out, 0);
+    writeU32(out, static_cast<uint32_t>(it->second));
+  }
+
+  out.close();
+  if (!out) {
+    throw std::runtime_error("Failed to write index run: " + path.string());
+  }
+
+  counts_.clear();
+  memoryUsed_ = 0;
+}
+
+void TermCounter::forEach(
+    const std::function<void(const std::string &, int)> &sink) {
+  if (runs_.empty()) {
+    for (const auto &it : sortedTerms(counts_)) {
+      sink(it->first, it->second);
+    }
+    return;
+  }
+
+  spill();
+
+  std::vector<std::unique_ptr<RunReader>> readers;
+  readers.reserve(runs_.size());
+  for (const auto &path : runs_) {
+    readers.push_back(std::make_unique<RunReader>(path));
+  }
+
+  auto greater = [&](size_t a, size_t b) {
+    return readers[a]->term() > readers[b]->term();
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+  for (size_t i = 0; i < readers.size(); ++i) {
+    if (readers[i]->next()) {
+      heap.push(i);
+    }
+  }
+
+  std::string term;
+  while (!heap.empty()) {
+    term = readers[heap.top()]->term();
+    int count = 0;
+    while (!heap.empty() && readers[heap.top()]->term() == term) {
+      size_t run = heap.top();
+      heap.pop();
+      count += readers[run]->postings().front().second;
+      if (readers[run]->next()) {
+        heap.push(run);
+      }
+    }
+    sink(term, count);
+  }
+}
+
+IndexBuilder::IndexBuilder(Database &db, const IndexBuildOptions &options)
+    : db_(db), options_(options), memoryUsed_(0) {
+  if (options_.spillDirectory.empty()) {
+    options_.spillDirectory = std::filesystem::temp_directory_path();
+  }
+  if (options_.memoryBudget == 0) {
+    options_.memoryBudget = options_.memory
+                                ? options_.memory->share(MemoryComponent::Index)
+                                : IndexBuildOptions::DEFAULT_MEMORY_BUDGET;
+  }
+}
+
+IndexBuilder::~IndexBuilder() { removeRuns(); }
 
 void IndexBuilder::indexFile(const std::string &filePath,
-                             const std::vector<std::string> &tokens) {
+                             const std::vector<std::string> &tokens,
+                             std::string_view text, bool completeText) {
+  std::vector<std::string_view> sorted(tokens.begin(), tokens.end());
+  std::sort(sorted.begin(), sorted.end());
+
+  TokenCounts tokenFrequency;
+  for (auto token : sorted) {
+    if (!tokenFrequency.empty() && tokenFrequency.back().first == token) {
+      tokenFrequency.back().second++;
+    } else {
+      tokenFrequency.emplace_back(token, 1);
+    }
+  }
+
+  indexDocument(filePath, tokenFrequency, text, completeText);
+}
+
+// Indexes the terms in batches, so a document's vocabulary is never held
+// in memory at once. Only the text seen so far is stored, and it does not
+// cover the document for --regex.
+void IndexBuilder::indexTermCounts(const std::string &filePath,
+                                   TermCounter &counts, std::string_view text) {
+  int fileId = db_.getFileId(filePath);
+  if (fileId == -1) {
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  TokenCounts batch;
+  auto flushBatch = [&] {
+    if (options_.mode == BuildMode::Spimi) {
+      invert(fileId, batch);
+    } else {
+      indexDirect(fileId, batch);
+    }
+    batch.clear();
+  };
+  counts.forEach([&](const std::string &token, int count) {
+    batch.emplace_back(token, count);
+    if (batch.size() == TERM_BATCH) {
+      flushBatch();
+    }
+  });
+  if (!batch.empty()) {
+    flushBatch();
+  }
+
+  if (options_.documentStore && !text.empty()) {
+    options_.documentStore->add(fileId, text);
+  }
+
+  stats_.filesIndexed++;
+  stats_.buildTime += std::chrono::steady_clock::now() - start;
+}
+
+void IndexBuilder::indexDocument(const std::string &filePath,
+                                 const TokenCounts &tokenFrequency,
+                                 std::string_view text, bool completeText) {
   int fileId = db_.getFileId(filePath);
   if (fileId == -1) {
     return;
   }
 
-  std::map<std::string, int> tokenFrequency;
-  for (const auto &token : tokens) {
-    tokenFrequency[token]++;
+  auto start = std::chrono::steady_clock::now();
+
+  if (options_.mode == BuildMode::Spimi) {
+    invert(fileId, tokenFrequency);
+  } else {
+    indexDirect(fileId, tokenFrequency);
+  }
+
+  if (options_.documentStore && !text.empty()) {
+    options_.documentStore->add(fileId, text);
   }
+  if (options_.contentTrigrams && completeText) {
+    addTrigrams(fileId, text);
+  }
+
+  stats_.filesIndexed++;
+  stats_.buildTime += std::chrono::steady_clock::now() - start;
+}
 
+void IndexBuilder::indexDirect(int fileId, const TokenCounts &frequencies) {
   std::vector<std::tuple<std::string, int, int>> tokenData;
-  tokenData.reserve(tokenFrequency.size());
+  tokenData.reserve(frequencies.size());
 
-  for (const auto &[token, frequency] : tokenFrequency) {
+  for (const auto &[token, frequency] : frequencies) {
     tokenData.emplace_back(token, fileId, frequency);
   }
 
   db_.insertTokens(tokenData);
+  stats_.postingsWritten += tokenData.size();
+
+  if (options_.postingsCache) {
+    for (const auto &[token, frequency] : frequencies) {
+      options_.postingsCache->invalidate(token);
+    }
+  }
+}
+
+void IndexBuilder::invert(int fileId, const TokenCounts &frequencies) {
+  size_t before = memoryUsed_;
+  for (const auto &[token, frequency] : frequencies) {
+    auto [it, inserted] = dictionary_.try_emplace(token);
+    auto &postings = it->second;
+    if (inserted) {
+      memoryUsed_ += token.size() + TERM_OVERHEAD;
+    }
+
+    size_t capacity = postings.capacity();
+    postings.emplace_back(fileId, frequency);
+    memoryUsed_ += (postings.capacity() - capacity) * sizeof(postings[0]);
+  }
+  if (options_.memory) {
+    options_.memory->charge(MemoryComponent::Index, memoryUsed_ - before);
+  }
+
+  stats_.peakMemory = std::max(stats_.peakMemory, memoryUsed_);
+  if (memoryUsed_ >= options_.memoryBudget) {
+    spillRun();
+  }
+}
+
+void IndexBuilder::spillRun() {
+  if (dictionary_.empty()) {
+    return;
+  }
+
+  auto terms = sortedTerms(dictionary_);
+
+  auto path = makeRunPath(options_.spillDirectory);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Failed to create index run: " + path.string());
+  }
+  runs_.push_back(path);
+
+  for (auto &it : terms) {
+    auto &postings = it->second;
+    std::sort(postings.begin(), postings.end());
+
+    writeU32(out, static_cast<uint32_t>(it->first.size()));
+    out.write(it->first.data(), it->first.size());
+    writeU32(out, static_cast<uint32_t>(postings.size()));
+    for (const auto &[fileId, frequency] : postings) {
+      writeU32(out, static_cast<uint32_t>(fileId));
+      writeU32(out, static_cast<uint32_t>(frequency));
+    }
+  }
+
+  out.close();
+  if (!out) {
+    throw std::runtime_error("Failed to write index run: " + path.string());
+  }
+
+  stats_.runsSpilled++;
+  stats_.bytesSpilled += std::filesystem::file_size(path);
+
+  releaseDictionary();
+}
+
+void IndexBuilder::releaseDictionary() {
+  dictionary_.clear();
+  if (options_.memory) {
+    options_.memory->release(MemoryComponent::Index, memoryUsed_);
+  }
+  memoryUsed_ = 0;
+}
+
+// Only files whose whole text was seen are recorded as covered; streamed
+// files stay uncovered and regex search scans them directly.
+void IndexBuilder::addTrigrams(int fileId, std::string_view text) {
+  size_t before = trigramRows_.capacity();
+  for (uint32_t trigram : extractTrigrams(text)) {
+    trigramRows_.push_back(static_cast<uint64_t>(trigram) << 32 |
+                           static_cast<uint32_t>(fileId));
+  }
+  trigramFiles_.push_back(fileId);
+  if (options_.memory) {
+    options_.memory->charge(MemoryComponent::Index,
+                            (trigramRows_.capacity() - before) *
+                                sizeof(uint64_t));
+  }
+
+  if (trigramRows_.size() * sizeof(uint64_t) >= options_.memoryBudget / 4) {
+    flushTrigrams();
+  }
+}
+
+void IndexBuilder::flushTrigrams() {
+  if (trigramFiles_.empty()) {
+    return;
+  }
+
+  std::sort(trigramRows_.begin(), trigramRows_.end());
+  db_.putContentTrigrams(trigramRows_, trigramFiles_);
+  stats_.trigramsWritten += trigramRows_.size();
+
+  if (options_.memory) {
+    options_.memory->release(MemoryComponent::Index,
+                             trigramRows_.capacity() * sizeof(uint64_t));
+  }
+  trigramRows_ = {};
+  trigramFiles_.clear();
+}
+
+void IndexBuilder::finish() {
+  if (options_.documentStore) {
+    options_.documentStore->flush();
+  }
+  flushTrigrams();
+
+  if (options_.mode != BuildMode::Spimi) {
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (runs_.empty()) {
+    auto terms = sortedTerms(dictionary_);
+
+    size_t next = 0;
+    stats_.postingsWritten += db_.bulkLoadPostings(
+        [&](std::string &token, std::vector<std::pair<int, int>> &postings) {
+          if (next == terms.size()) {
+            return false;
+          }
+          token = terms[next]->first;
+          postings = std::move(terms[next]->second);
+          std::sort(postings.begin(), postings.end());
+          next++;
+          return true;
+        });
+
+    if (options_.postingsCache) {
+      for (const auto &term : terms) {
+        options_.postingsCache->invalidate(term->first);
+      }
+    }
+    releaseDictionary();
+  } else {
+    spillRun();
+    mergeRuns();
+  }
+
+  stats_.buildTime += std::chrono::steady_clock::now() - start;
+}
+
+void IndexBuilder::mergeRuns() {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  readers.reserve(runs_.size());
+  for (const auto &path : runs_) {
+    readers.push_back(std::make_unique<RunReader>(path));
+  }
+
+  auto greater = [&](size_t a, size_t b) {
+    return readers[a]->term() > readers[b]->term() ||
+           (readers[a]->term() == readers[b]->term() && a > b);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+
+  for (size_t i = 0; i < readers.size(); ++i) {
+    if (readers[i]->next()) {
+      heap.push(i);
+    }
+  }
+
+  stats_.postingsWritten += db_.bulkLoadPostings(
+      [&](std::string &token, std::vector<std::pair<int, int>> &postings) {
+        if (heap.empty()) {
+          return false;
+        }
+
+        token = readers[heap.top()]->term();
+        postings.clear();
+
+        while (!heap.empty() && readers[heap.top()]->term() == token) {
+          size_t run = heap.top();
+          heap.pop();
+
+          const auto &runPostings = readers[run]->postings();
+          size_t middle = postings.size();
+          postings.insert(postings.end(), runPostings.begin(),
+                          runPostings.end());
+          std::inplace_merge(postings.begin(), postings.begin() + middle,
+                             postings.end());
+
+          if (readers[run]->next()) {
+            heap.push(run);
+          }
+        }
+
+        return true;
+      });
+
+  // Merged runs rewrite most of the vocabulary; the terms are not kept.
+  if (options_.postingsCache) {
+    options_.postingsCache->clear();
+  }
+
+  readers.clear();
+  removeRuns();
+}
+
+void IndexBuilder::removeRuns() {
+  for (const auto &path : runs_) {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+  runs_.clear();
 }
 
 } // namespace glint
@@ -0,0 +1,538 @@
+#include "glint/content_hash.h"
+#include "glint/database.h"
+#include "glint/document_store.h"
+#include "glint/index_builder.h"
+#include "glint/memory_budget.h"
+#include "glint/parse_number.h"
+#include "glint/postings_cache.h"
+#include "glint/search_engine.h"
+#include "glint/text_extractor.h"
+#include "glint/tokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadTestConfig {
+  std::string dbPath = "glint.db";
+  std::string queryLog;
+  size_t zipfQueries = 10000;
+  double zipfExponent = 1.0;
+  size_t vocabulary = 1000;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  double duration = 10.0;
+  double warmup = 1.0;
+  size_t limit = 20;
+  bool previews = true;
+  bool writer = false;
+  size_t writerBatch = 32;
+  size_t memoryLimit = glint::MemoryBudget::DEFAULT_LIMIT;
+  size_t postingsCache = glint::PostingsCache::DEFAULT_CAPACITY;
+  unsigned seed = 1;
+};
+
+struct ClientStats {
+  std::vector<int64_t> latencies;
+  size_t errors = 0;
+  size_t pruned = 0;
+  size_t results = 0;
+};
+
+struct WriterStats {
+  std::vector<int64_t> batchLatencies;
+  size_t files = 0;
+  size_t skipped = 0;
+  size_t errors = 0;
+};
+
+size_t numberValue(const std::string &option, const std::string &value,
+                   size_t maxValue = std::numeric_limits<size_t>::max()) {
+  auto number = glint::parseNumber(value, 0, maxValue);
+  if (!number) {
+    throw std::invalid_argument(option + " requires a whole number, got '" +
+                                value + "'");
+  }
+  return *number;
+}
+
+double decimalValue(const std::string &option, const std::string &value) {
+  auto number = glint::parseDecimal(value);
+  if (!number) {
+    throw std::invalid_argument(option + " requires a non-negative number, " +
+                                "got '" + value + "'");
+  }
+  return *number;
+}
+
+void printHelp() {
+  std::cout << "Usage: glint_loadtest [options]\n\n";
+  std::cout << "Replays queries against an index from concurrent clients "
+               "and reports\nthroughput, latency percentiles and cache hit "
+               "rates.\n\n";
+  std::cout << "Options:\n";
+  std::cout << "  --help              Show this help message\n";
+  std::cout << "  --db <path>         Database file path (default: glint.db)\n";
+  std::cout << "  --queries <file>    Replay a query log, one query per line\n";
+  std::cout << "  --zipf <n>          Generate n queries from a Zipfian term "
+               "mix (default: 10000)\n";
+  std::cout << "  --zipf-s <s>        Zipf exponent (default: 1.0)\n";
+  std::cout << "  --vocabulary <n>    Most frequent terms to draw from "
+               "(default: 1000)\n";
+  std::cout << "  --seed <n>          Seed for the generated mix "
+               "(default: 1)\n";
+  std::cout << "  --threads <n>       Concurrent clients (default: hardware "
+               "threads)\n";
+  std::cout << "  --duration <s>      Measured run time (default: 10)\n";
+  std::cout << "  --warmup <s>        Unmeasured run time first "
+               "(default: 1)\n";
+  std::cout << "  --limit <n>         Results per query (default: 20)\n";
+  std::cout << "  --no-previews       Skip result previews\n";
+  std::cout << "  --writer            Re-index indexed files in the "
+               "background\n";
+  std::cout << "  --writer-batch <n>  Files per writer transaction "
+               "(default: 32)\n";
+  std::cout << "  --memory-limit <MB> Memory for the SQLite caches "
+               "(default: 256)\n";
+  std::cout << "  --postings-cache <MB> Hot postings cache, 0 to disable "
+               "(default: 32)\n";
+}
+
+std::vector<std::string> readQueryLog(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error("Failed to open query log: " + path);
+  }
+
+  std::vector<std::string> queries;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty() && line[0] != '#') {
+      queries.push_back(line);
+    }
+  }
+  return queries;
+}
+
+// Queries of one to three terms whose popularity follows Zipf's law over
+// the index's most frequent terms, the usual shape of real query logs.
+std::vector<std::string> generateQueries(const glint::Database &db,
+                                         const LoadTestConfig &config) {
+  auto terms = db.getFrequentTokens(config.vocabulary);
+  if (terms.empty()) {
+    throw std::runtime_error("The index has no terms to query");
+  }
+
+  std::vector<double> weights;
+  for (size_t rank = 1; rank <= terms.size(); ++rank) {
+    weights.push_back(1.0 / std::pow(static_cast<double>(rank),
+                                     config.zipfExponent));
+  }
+
+  std::mt19937 random(config.seed);
+  std::discrete_distribution<size_t> term(weights.begin(), weights.end());
+  std::discrete_distribution<size_t> length({50, 35, 15});
+
+  std::vector<std::string> queries;
+  queries.reserve(config.zipfQueries);
+  for (size_t i = 0; i < config.zipfQueries; ++i) {
+    std::string query = terms[term(random)].first;
+    for (size_t extra = length(random); extra > 0; --extra) {
+      query += " " + terms[term(random)].first;
+    }
+    queries.push_back(std::move(query));
+  }
+  return queries;
+}
+
+int64_t percentile(const std::vector<int64_t> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+std::string millis(int64_t nanoseconds) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2) << (nanoseconds / 1e6) << " ms";
+  return out.str();
+}
+
+// Re-indexes files that are already in the index, so every batch takes the
+// write lock and marks score bounds stale without changing any results.
+// Only content owners whose size, mtime and content hash still match what
+// the crawl recorded are touched. Their postings, preview and trigrams are
+// then rewritten with identical values, each in a single transaction, so
+// readers never see the file missing and an interrupted run leaves the
+// index as it was.
+void runWriter(const LoadTestConfig &config, glint::PostingsCache *cache,
+               const std::atomic<bool> &stop, WriterStats &stats) {
+  glint::DatabaseOptions options;
+  options.readerCount = 1;
+  options.postingsCache = cache;
+  glint::Database db(config.dbPath, options);
+  db.initialize();
+
+  std::unique_ptr<glint::DocumentStore> docStore;
+  auto docStorePath = glint::DocumentStore::pathFor(config.dbPath);
+  if (std::filesystem::exists(docStorePath)) {
+    docStore = std::make_unique<glint::DocumentStore>(db, docStorePath);
+  }
+  glint::IndexBuildOptions buildOptions;
+  buildOptions.postingsCache = cache;
+  buildOptions.documentStore = docStore.get();
+  buildOptions.contentTrigrams = !db.getTrigramCoveredFiles().empty();
+  glint::IndexBuilder builder(db, buildOptions);
+
+  auto fileIds = db.getIndexedFiles();
+  if (fileIds.empty()) {
+    return;
+  }
+
+  size_t next = 0;
+  while (!stop) {
+    auto start = Clock::now();
+    try {
+      for (size_t i = 0; i < config.writerBatch && !stop; ++i) {
+        int fileId = fileIds[next++ % fileIds.size()];
+        std::string path = db.getFilePath(fileId);
+        auto record = db.getFileRecord(path);
+        glint::FileInfo file(path);
+        if (!record || !record->contentHash || !db.hasFileTokens(fileId) ||
+            db.isStreamed(fileId) || record->size != file.size ||
+            record->modifiedTime !=
+                file.lastModified.time_since_epoch().count()) {
+          stats.skipped++;
+          continue;
+        }
+
+        std::string text = glint::TextExtractor::extractText(path);
+        if (text.empty() ||
+            glint::ContentHasher::hash(text) != *record->contentHash) {
+          stats.skipped++;
+          continue;
+        }
+
+        bool completeText = file.size <= glint::TextExtractor::MAX_FILE_SIZE;
+        builder.indexFile(path,
+                          glint::tokenize(glint::textKindFor(path), text),
+                          text, completeText);
+        stats.files++;
+      }
+      builder.finish();
+    } catch (const std::exception &) {
+      stats.errors++;
+    }
+    stats.batchLatencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count());
+  }
+
+  db.refreshScoreBounds();
+}
+
+double runClients(const glint::SearchEngine &engine,
+                  const std::vector<std::string> &queries,
+                  const LoadTestConfig &config, double seconds,
+                  std::vector<ClientStats> &clients) {
+  std::atomic<size_t> next{0};
+  std::atomic<bool> stop{false};
+  clients.assign(config.threads, {});
+
+  auto client = [&](ClientStats &stats) {
+    glint::SearchOptions options;
+    options.limit = config.limit;
+    options.previews = config.previews;
+    glint::SearchStats searchStats;
+    options.stats = &searchStats;
+
+    while (!stop) {
+      const auto &query = queries[next++ % queries.size()];
+      auto start = Clock::now();
+      try {
+        stats.results += engine.search(query, options).size();
+        if (searchStats.pruned) {
+          stats.pruned++;
+        }
+      } catch (const std::exception &) {
+        stats.errors++;
+      }
+      stats.latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                               start)
+              .count());
+    }
+  };
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (auto &stats : clients) {
+    threads.emplace_back(client, std::ref(stats));
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const std::vector<ClientStats> &clients, double seconds,
+            const glint::PageCacheStats &cache,
+            const glint::PostingsCacheStats *postings) {
+  std::vector<int64_t> latencies;
+  size_t errors = 0;
+  size_t pruned = 0;
+  size_t results = 0;
+  for (const auto &stats : clients) {
+    latencies.insert(latencies.end(), stats.latencies.begin(),
+                     stats.latencies.end());
+    errors += stats.errors;
+    pruned += stats.pruned;
+    results += stats.results;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  size_t completed = latencies.size();
+  std::cout << "Queries: " << completed << " in " << std::fixed
+            << std::setprecision(2) << seconds << " s (" << errors
+            << " failed)\n";
+  std::cout << "Throughput: " << std::setprecision(1)
+            << (completed / seconds) << " queries/s\n";
+  if (completed == 0) {
+    return;
+  }
+
+  std::cout << "Latency: p50 " << millis(percentile(latencies, 0.50))
+            << ", p95 " << millis(percentile(latencies, 0.95)) << ", p99 "
+            << millis(percentile(latencies, 0.99)) << ", p999 "
+            << millis(percentile(latencies, 0.999)) << ", max "
+            << millis(latencies.back()) << "\n";
+  std::cout << "Results: " << std::setprecision(1)
+            << (static_cast<double>(results) / completed)
+            << " per query, top-k pruning on " << (100.0 * pruned / completed)
+            << "%\n";
+
+  int64_t lookups = cache.hits + cache.misses;
+  std::cout << "SQLite page cache: " << cache.hits << " hits, "
+            << cache.misses << " misses";
+  if (lookups > 0) {
+    std::cout << " (" << std::setprecision(1)
+              << (100.0 * cache.hits / lookups) << "% hit rate)";
+  }
+  std::cout << "\n";
+
+  if (postings) {
+    std::cout << "Postings cache: " << postings->hits << " hits, "
+              << postings->misses << " misses (" << std::setprecision(1)
+              << (100.0 * postings->hitRate()) << "% hit rate), "
+              << postings->entries << " terms in " << std::setprecision(2)
+              << (postings->bytes / 1024.0 / 1024.0) << " MB\n";
+    std::cout << "Postings cache admission: " << postings->admitted
+              << " admitted, " << postings->rejected << " rejected, "
+              << postings->evicted << " evicted, " << postings->invalidated
+              << " invalidated\n";
+  }
+}
+
+void reportWriter(const WriterStats &stats, double seconds) {
+  auto latencies = stats.batchLatencies;
+  std::sort(latencies.begin(), latencies.end());
+
+  std::cout << "Writer: " << stats.files << " files re-indexed in "
+            << latencies.size() << " batch(es), " << std::fixed
+            << std::setprecision(1) << (stats.files / seconds)
+            << " files/s (" << stats.skipped << " changed or shared, "
+            << stats.errors << " failed)\n";
+  if (!latencies.empty()) {
+    std::cout << "Writer batch latency: p50 "
+              << millis(percentile(latencies, 0.50)) << ", p99 "
+              << millis(percentile(latencies, 0.99)) << ", max "
+              << millis(latencies.back()) << "\n";
+  }
+}
+
+int runLoadTest(const LoadTestConfig &config) {
+  glint::MemoryBudget memory(config.memoryLimit);
+  glint::DatabaseOptions dbOptions;
+  dbOptions.readerCount = config.threads;
+  dbOptions.connectionCacheBytes =
+      memory.share(glint::MemoryComponent::SqliteCache) /
+      (dbOptions.readerCount + 1);
+  glint::Database db(config.dbPath, dbOptions);
+  db.initialize();
+
+  std::unique_ptr<glint::DocumentStore> docStore;
+  auto docStorePath = glint::DocumentStore::pathFor(config.dbPath);
+  if (config.previews && std::filesystem::exists(docStorePath)) {
+    docStore = std::make_unique<glint::DocumentStore>(db, docStorePath);
+  }
+  std::unique_ptr<glint::PostingsCache> postingsCache;
+  if (config.postingsCache > 0) {
+    postingsCache =
+        std::make_unique<glint::PostingsCache>(config.postingsCache);
+  }
+  glint::SearchEngine engine(db, docStore.get(), postingsCache.get());
+
+  auto queries = config.queryLog.empty() ? generateQueries(db, config)
+                                         : readQueryLog(config.queryLog);
+  if (queries.empty()) {
+    std::cerr << "Error: no queries to replay\n";
+    return 1;
+  }
+
+  std::cout << "Load test: " << queries.size() << " "
+            << (config.queryLog.empty() ? "generated" : "logged")
+            << " queries, " << config.threads << " client(s), top "
+            << config.limit << (config.writer ? ", background writer" : "")
+            << "\n";
+  std::cout << "Database: " << config.dbPath << "\n\n";
+
+  std::vector<ClientStats> clients;
+  if (config.warmup > 0) {
+    runClients(engine, queries, config, config.warmup, clients);
+  }
+
+  std::atomic<bool> stopWriter{false};
+  WriterStats writerStats;
+  std::thread writer;
+  if (config.writer) {
+    writer = std::thread([&] {
+      try {
+        runWriter(config, postingsCache.get(), stopWriter, writerStats);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: writer: " << e.what() << "\n";
+      }
+    });
+  }
+
+  auto before = db.getPageCacheStats();
+  glint::PostingsCacheStats postingsBefore;
+  if (postingsCache) {
+    postingsBefore = postingsCache->getStats();
+  }
+  double seconds = runClients(engine, queries, config, config.duration,
+                              clients);
+  auto after = db.getPageCacheStats();
+  glint::PostingsCacheStats postings;
+  if (postingsCache) {
+    postings = postingsCache->getStats();
+    postings.hits -= postingsBefore.hits;
+    postings.misses -= postingsBefore.misses;
+    postings.admitted -= postingsBefore.admitted;
+    postings.rejected -= postingsBefore.rejected;
+    postings.evicted -= postingsBefore.evicted;
+    postings.invalidated -= postingsBefore.invalidated;
+  }
+
+  stopWriter = true;
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  report(clients, seconds, {after.hits - before.hits,
+                            after.misses - before.misses},
+         postingsCache ? &postings : nullptr);
+  if (config.writer) {
+    reportWriter(writerStats, seconds);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  LoadTestConfig config;
+
+  try {
+    for (size_t i = 0; i < args.size(); ++i) {
+      const auto &arg = args[i];
+      bool hasValue = i + 1 < args.size();
+
+      if (arg == "--help") {
+        printHelp();
+        return 0;
+      }
+      if (arg == "--no-previews") {
+        config.previews = false;
+        continue;
+      }
+      if (arg == "--writer") {
+        config.writer = true;
+        continue;
+      }
+      if (!hasValue) {
+        std::cerr << "Error: unknown option or missing value: " << arg
+                  << "\n";
+        return 1;
+      }
+
+      const auto &value = args[++i];
+      if (arg == "--db") {
+        config.dbPath = value;
+      } else if (arg == "--queries") {
+        config.queryLog = value;
+      } else if (arg == "--zipf") {
+        config.zipfQueries = numberValue(arg, value);
+      } else if (arg == "--zipf-s") {
+        config.zipfExponent = decimalValue(arg, value);
+      } else if (arg == "--vocabulary") {
+        config.vocabulary = numberValue(arg, value);
+      } else if (arg == "--seed") {
+        config.seed = static_cast<unsigned>(
+            numberValue(arg, value, std::numeric_limits<unsigned>::max()));
+      } else if (arg == "--threads") {
+        config.threads = std::max<size_t>(1, numberValue(arg, value));
+      } else if (arg == "--duration") {
+        config.duration = decimalValue(arg, value);
+      } else if (arg == "--warmup") {
+        config.warmup = decimalValue(arg, value);
+      } else if (arg == "--limit") {
+        config.limit = numberValue(arg, value);
+      } else if (arg == "--writer-batch") {
+        config.writerBatch = std::max<size_t>(1, numberValue(arg, value));
+      } else if (arg == "--memory-limit") {
+        config.memoryLimit =
+            numberValue(arg, value, glint::MAX_MEGABYTES) * 1024 * 1024;
+      } else if (arg == "--postings-cache") {
+        config.postingsCache =
+            numberValue(arg, value, glint::MAX_MEGABYTES) * 1024 * 1024;
+      } else {
+        std::cerr << "Error: unknown option: " << arg << "\n";
+        return 1;
+      }
+    }
+
+    if (!std::filesystem::exists(config.dbPath)) {
+      std::cerr << "Error: database not found: " << config.dbPath << "\n";
+      return 1;
+    }
+    return runLoadTest(config);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
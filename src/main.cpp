@@ -1,17 +1,37 @@
+#include "glint/batch_reader.h"
+#include "glint/content_hash.h"
+#include "glint/content_sniffer.h"
 #include "glint/crawler.h"
 #include "glint/database.h"
+#include "glint/document_store.h"
 #include "glint/index_builder.h"
+#include "glint/memory_budget.h"
+#include "glint/parse_number.h"
+#include "glint/regex_search.h"
 #include "glint/search_engine.h"
+#include "glint/search_tui.h"
 #include "glint/text_extractor.h"
 #include "glint/tokenizer.h"
 
+#include <algorithm>
 #include <chrono>
+#include <csignal>
 #include <iomanip>
 #include <iostream>
-#include <set>
+#include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Bounds --limit and --page so that (page - 1) * limit cannot overflow.
+constexpr size_t MAX_PAGE_OFFSET = 1000000000;
+
 void printVersion() {
   std::cout << "Glint v0.1.0\n";
   std::cout << "Local Search Engine\n";
@@ -23,99 +43,406 @@ void printHelp() {
   std::cout << "  --help              Show this help message\n";
   std::cout << "  --version           Show version information\n";
   std::cout << "  --crawl <path>      Crawl directory and index files\n";
+  std::cout << "  --merge <out> <in>... Merge indexes into one; the newest "
+               "version of a path wins\n";
   std::cout << "  --db <path>         Database file path (default: glint.db)\n";
   std::cout
       << "  --search <query>    Search for files containing query terms\n";
+  std::cout << "  --tui               Interactive search-as-you-type\n";
+  std::cout << "  --find <substring>  List indexed paths containing a "
+               "substring\n";
+  std::cout << "  --regex <pattern>   List lines matching a regular "
+               "expression\n";
+  std::cout << "  --ignore-case       Case-insensitive --regex\n";
   std::cout << "  --type <ext>        Filter results by file extension\n";
+  std::cout << "  --under <dir>       Only search files below a directory\n";
+  std::cout << "  --limit <n>         Results per page (default: 20)\n";
+  std::cout << "  --page <n>          Page of results to show (default: 1)\n";
+  std::cout << "  --build-mode <mode>  Index build mode: direct or spimi "
+               "(default: direct)\n";
+  std::cout << "  --memory-limit <MB> Memory shared by the SQLite cache, "
+               "crawler, reader and index (default: 256)\n";
+  std::cout << "                      Files larger than the reader share are "
+               "streamed, so a small\n"
+               "                      limit streams more files and phrase "
+               "searches re-read them\n";
+  std::cout << "  --index-memory <MB> Memory budget for spimi inversion "
+               "(default: 40% of --memory-limit)\n";
+  std::cout << "  --max-file-size <MB> Size above which the oversize policy "
+               "applies (default: 10)\n";
+  std::cout << "  --oversize <policy> Large files: skip, truncate or stream "
+               "(default: stream)\n";
+  std::cout << "  --trigrams          Also index content trigrams to speed up "
+               "--regex\n";
+  std::cout << "  --restart           Ignore a saved crawl checkpoint and "
+               "start from the top\n";
+  std::cout << "  --no-docstore       Do not keep compressed document text for "
+               "previews\n";
+  std::cout << "  --bench-read <path> Compare file read throughput of the "
+               "extraction backends\n";
+  std::cout << "  --bench-search      Compare exhaustive and pruned top-k "
+               "search on common terms\n";
+  std::cout << "  --maintain          Reclaim free pages online in small "
+               "throttled steps\n";
+  std::cout << "                      and compact the document store once "
+               "25% is superseded\n";
+  std::cout << "  --io-budget <MB/s>  I/O budget for --maintain "
+               "(default: 16)\n";
+  std::cout << "  --vacuum            Rewrite the database offline and enable "
+               "incremental vacuum\n";
   std::cout << "  --stats             Show performance statistics\n";
   std::cout << "  --verbose           Show detailed processing information\n";
 }
 
-void crawlDirectory(const std::string &path, const std::string &dbPath,
-                    bool verbose, bool showStats) {
+volatile std::sig_atomic_t interruptSignal = 0;
+
+// The first SIGINT/SIGTERM lets the crawl commit its current batch and
+// checkpoint; a second one falls through to the default handler.
+void handleInterrupt(int signal) {
+  interruptSignal = signal;
+  std::signal(signal, SIG_DFL);
+}
+
+// Consumes the value of a numeric option. Prints what the option requires
+// and returns nullopt when the value is missing, malformed or out of range.
+std::optional<size_t> numberArgument(const std::vector<std::string> &args,
+                                     size_t &i, const char *requirement,
+                                     size_t minValue = 0,
+                                     size_t maxValue = glint::MAX_MEGABYTES) {
+  std::optional<size_t> value;
+  if (i + 1 < args.size()) {
+    value = glint::parseNumber(args[i + 1], minValue, maxValue);
+  }
+  if (!value) {
+    std::cerr << "Error: " << args[i] << " requires " << requirement << "\n";
+    return std::nullopt;
+  }
+  ++i;
+  return value;
+}
+
+void printDocumentStore(const glint::DocumentStoreStats &stats,
+                        bool suggestCompaction) {
+  std::cout << "Document store file: " << std::fixed << std::setprecision(2)
+            << (stats.fileBytes / 1024.0 / 1024.0) << " MB, "
+            << stats.documents << " document(s), " << std::setprecision(1)
+            << (stats.deadRatio() * 100.0) << "% superseded";
+  if (suggestCompaction &&
+      stats.deadRatio() >= glint::DocumentStore::COMPACT_DEAD_RATIO) {
+    std::cout << " (reclaim with --maintain)";
+  }
+  std::cout << "\n";
+}
+
+int crawlDirectory(const std::string &crawlPath, const std::string &dbPath,
+                   glint::IndexBuildOptions buildOptions,
+                   glint::ExtractionPolicy extraction, size_t memoryLimit,
+                   bool useDocStore, bool resume, bool verbose,
+                   bool showStats) {
   auto startTime = std::chrono::high_resolution_clock::now();
+  std::string path = glint::canonicalPath(crawlPath).string();
 
   std::cout << "Crawling directory: " << path << "\n";
   std::cout << "Database: " << dbPath << "\n\n";
 
   try {
-    glint::Database db(dbPath);
+    glint::MemoryBudget memory(memoryLimit);
+    glint::DatabaseOptions dbOptions;
+    dbOptions.connectionCacheBytes =
+        memory.share(glint::MemoryComponent::SqliteCache) /
+        (dbOptions.readerCount + 1);
+    glint::Database db(dbPath, dbOptions);
     db.initialize();
 
-    glint::IndexBuilder indexBuilder(db);
+    // Earlier crawls stored paths under the root as it was typed.
+    auto typedRoot = std::filesystem::path(crawlPath).lexically_normal();
+    if (!typedRoot.has_filename() && typedRoot.has_relative_path()) {
+      typedRoot = typedRoot.parent_path();
+    }
+    if (typedRoot.string() != path) {
+      size_t renamed = db.renamePaths(typedRoot.string(), path);
+      if (renamed > 0) {
+        std::cout << "Moved " << renamed << " path(s) stored as "
+                  << typedRoot.string() << " to " << path << "\n";
+      }
+    }
+
+    std::unique_ptr<glint::DocumentStore> docStore;
+    if (useDocStore) {
+      docStore = std::make_unique<glint::DocumentStore>(
+          db, glint::DocumentStore::pathFor(dbPath));
+      buildOptions.documentStore = docStore.get();
+    }
+
+    buildOptions.memory = &memory;
+
+    glint::BatchReaderOptions readerOptions;
+    readerOptions.maxInflightBytes =
+        memory.share(glint::MemoryComponent::Reader);
+    readerOptions.memory = &memory;
+    // Files that would not fit the reader share are streamed instead; their
+    // phrases are then verified against the file on disk.
+    if (extraction.oversize == glint::OversizePolicy::Stream) {
+      extraction.maxFileSize =
+          std::min(extraction.maxFileSize, readerOptions.maxInflightBytes);
+    }
+
+    glint::IndexBuilder indexBuilder(db, buildOptions);
     glint::DirectoryCrawler crawler(path);
+    glint::ContentClassCache contentClasses(db);
+    glint::BatchReader reader(readerOptions);
+
+    // A file indexed as text that is now classified binary never reaches a
+    // batch, so its postings and row are dropped here.
+    size_t removedBinaryCount = 0;
+    crawler.setFileFilter([&](const glint::FileInfo &info) {
+      if (contentClasses.isText(info)) {
+        return true;
+      }
+      int fileId = db.getFileId(info.path.string());
+      if (fileId != -1) {
+        db.deleteFile(fileId);
+        removedBinaryCount++;
+      }
+      return false;
+    });
+
+    // Checkpoint paths are stored relative to the crawl root. Files up to
+    // the pending path may have been half-indexed by an interrupted run, so
+    // their size and mtime alone are not trusted.
+    glint::CrawlCheckpoint progress;
+    progress.root = path;
+    std::filesystem::path recheckUntil;
+    if (auto saved = db.getCrawlCheckpoint(progress.root)) {
+      if (resume) {
+        progress = *saved;
+        if (!progress.frontier.empty()) {
+          crawler.setResumeAfter(std::filesystem::path(path) /
+                                 progress.frontier);
+          std::cout << "Resuming after " << progress.files << " files ("
+                    << progress.frontier << ")\n\n";
+        }
+        if (!progress.pending.empty()) {
+          recheckUntil = std::filesystem::path(path) / progress.pending;
+        }
+      } else {
+        db.deleteCrawlCheckpoint(progress.root);
+      }
+    }
+
+    interruptSignal = 0;
+    std::signal(SIGINT, handleInterrupt);
+    std::signal(SIGTERM, handleInterrupt);
+    crawler.setCancelled([] { return interruptSignal != 0; });
+
+    extraction.sniffContent = false;
 
     size_t fileCount = 0;
     size_t skippedCount = 0;
     size_t indexedCount = 0;
+    size_t streamedCount = 0;
+    size_t batchCount = 0;
     std::uintmax_t totalSize = 0;
     size_t totalTokens = 0;
-    std::set<std::string> uniqueTokens;
+    std::unordered_map<uint64_t, int> contentOwners;
+    size_t unchangedContentCount = 0;
+    size_t dedupedCount = 0;
 
     crawler.setProgressCallback([&](const glint::FileInfo &info) {
       fileCount++;
       totalSize += info.size;
 
-      std::string text = glint::TextExtractor::extractText(info.path);
-      if (!text.empty()) {
-        auto tokens = glint::Tokenizer::tokenize(text);
-        totalTokens += tokens.size();
+      if (fileCount % 100 == 0) {
+        std::cout << "\rProcessed: " << fileCount << " files" << std::flush;
+      }
+    });
 
-        for (const auto &token : tokens) {
-          uniqueTokens.insert(token);
-        }
+    crawler.setBatchCallback([&](std::vector<glint::FileInfo> &results) {
+      contentClasses.flush();
 
-        if (verbose && !tokens.empty()) {
-          std::cout << "\n"
-                    << info.path.filename().string() << ": " << tokens.size()
-                    << " tokens\n";
-        }
+      auto batchEnd = results.back().path.lexically_relative(path);
+      if (progress.pending.empty() ||
+          batchEnd.compare(progress.pending) > 0) {
+        progress.pending = batchEnd.string();
       }
+      db.putCrawlCheckpoint(progress);
 
-      if (fileCount % 100 == 0) {
-        std::cout << "\rProcessed: " << fileCount << " files" << std::flush;
+      std::sort(results.begin(), results.end(),
+                [](const glint::FileInfo &a, const glint::FileInfo &b) {
+                  return a.path.native() < b.path.native();
+                });
+      batchCount++;
+
+      if (verbose) {
+        std::cout << "\r\nIndexing batch " << batchCount << " ("
+                  << results.size() << " files)...\n";
       }
-    });
 
-    auto results = crawler.crawl();
+      std::vector<std::optional<glint::FileRecord>> previous;
+      previous.reserve(results.size());
+      for (const auto &file : results) {
+        previous.push_back(db.getFileRecord(file.path.string()));
+      }
+      db.insertFiles(results);
 
-    std::cout << "\r\nStoring files in database...\n";
-    db.insertFiles(results);
+      std::vector<glint::ReadRequest> pendingReads;
+      std::vector<std::pair<size_t, int>> pendingFiles;
 
-    std::cout << "Building inverted index...\n";
-    for (const auto &file : results) {
-      int fileId = db.getFileId(file.path.string());
+      auto claimContent = [&](size_t index, int fileId, uint64_t contentHash) {
+        const auto &record = previous[index];
+        if (record && record->contentHash == contentHash &&
+            (db.hasFileTokens(fileId) || contentOwners.count(contentHash) > 0 ||
+             db.findContentOwner(contentHash, fileId) != -1)) {
+          unchangedContentCount++;
+          return false;
+        }
+
+        if (record) {
+          db.releaseFileContent(fileId);
+        }
+        db.setContentHash(fileId, contentHash);
+
+        auto owner = contentOwners.find(contentHash);
+        if (owner != contentOwners.end() ||
+            db.findContentOwner(contentHash, fileId) != -1) {
+          dedupedCount++;
+          return false;
+        }
+
+        contentOwners.emplace(contentHash, fileId);
+        return true;
+      };
+
+      for (size_t i = 0; i < results.size(); ++i) {
+        const auto &file = results[i];
+        const auto &record = previous[i];
+
+        bool recheck = !recheckUntil.empty() &&
+                       file.path.compare(recheckUntil) <= 0;
+        if (!recheck && record && record->contentHash &&
+            record->modifiedTime ==
+                file.lastModified.time_since_epoch().count() &&
+            record->size == file.size) {
+          skippedCount++;
+          continue;
+        }
+
+        int fileId = record ? record->id : db.getFileId(file.path.string());
+        if (fileId == -1) {
+          continue;
+        }
 
-      if (fileId != -1 &&
-          !db.isFileModified(file.path.string(), file.lastModified) &&
-          db.hasFileTokens(fileId)) {
-        skippedCount++;
-        continue;
+        if (file.size > extraction.maxFileSize &&
+            extraction.oversize == glint::OversizePolicy::Stream) {
+          glint::TermCounter counts(
+              memory.share(glint::MemoryComponent::Reader),
+              buildOptions.spillDirectory);
+          std::string prefix;
+          glint::ContentHasher hasher;
+
+          bool extracted = glint::withTokenizer(
+              glint::textKindFor(file.path), [&](auto tokenizer) {
+                typename decltype(tokenizer)::Stream stream(
+                    [&](std::string &&token) { counts.add(std::move(token)); });
+
+                bool complete = glint::TextExtractor::extractChunks(
+                    file.path, extraction, [&](std::string_view chunk) {
+                      if (prefix.empty()) {
+                        prefix = chunk;
+                      }
+                      hasher.update(chunk);
+                      stream.feed(chunk);
+                      return true;
+                    });
+                stream.finish();
+                return complete;
+              });
+
+          if (extracted && claimContent(i, fileId, hasher.digest())) {
+            db.markStreamed(fileId);
+            totalTokens += counts.getTokenCount();
+            indexBuilder.indexTermCounts(file.path.string(), counts, prefix);
+            indexedCount++;
+            streamedCount++;
+          }
+          continue;
+        }
+
+        if (file.size == 0 ||
+            (file.size > extraction.maxFileSize &&
+             extraction.oversize == glint::OversizePolicy::Skip)) {
+          continue;
+        }
+
+        pendingReads.push_back(
+            {file.path, static_cast<size_t>(std::min<std::uintmax_t>(
+                            file.size, extraction.maxFileSize))});
+        pendingFiles.emplace_back(i, fileId);
       }
 
-      std::string text = glint::TextExtractor::extractText(file.path);
-      if (!text.empty()) {
-        if (fileId != -1) {
-          db.deleteFileTokens(fileId);
+      reader.readAll(pendingReads, [&](size_t index, std::string &&text,
+                                       int error) {
+        if (error != 0 || text.empty()) {
+          return;
         }
 
-        auto tokens = glint::Tokenizer::tokenize(text);
-        indexBuilder.indexFile(file.path.string(), tokens);
+        auto [resultIndex, fileId] = pendingFiles[index];
+        if (!claimContent(resultIndex, fileId,
+                          glint::ContentHasher::hash(text))) {
+          return;
+        }
+
+        auto tokens = glint::tokenize(
+            glint::textKindFor(pendingReads[index].path), text);
+        totalTokens += tokens.size();
+        if (verbose && !tokens.empty()) {
+          std::cout << pendingReads[index].path.filename().string() << ": "
+                    << tokens.size() << " tokens\n";
+        }
+        // A truncated read only covers a prefix, so its trigrams must not
+        // mark the file as covered for --regex.
+        bool completeText = results[resultIndex].size <= extraction.maxFileSize;
+        indexBuilder.indexFile(pendingReads[index].path.string(), tokens, text,
+                               completeText);
         indexedCount++;
+      });
+
+      indexBuilder.finish();
+      progress.frontier = batchEnd.string();
+      progress.files += results.size();
+      if (batchEnd.compare(progress.pending) >= 0) {
+        progress.pending.clear();
       }
+      db.putCrawlCheckpoint(progress);
+    }, memory);
+
+    crawler.crawl();
+    contentClasses.flush();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    std::cout << "\rProcessed: " << fileCount << " files\n";
+
+    if (interruptSignal != 0) {
+      std::cout << "\nInterrupted; progress saved after " << progress.files
+                << " files. Run the same --crawl again to resume.\n";
+      return 130;
     }
 
+    std::cout << "Building inverted index...\n";
+    indexBuilder.finish();
+    db.deleteCrawlCheckpoint(progress.root);
+    size_t boundsRefreshed = db.refreshScoreBounds();
+
     auto endTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
         endTime - startTime);
 
     std::cout << "\nCrawl complete!\n";
-    std::cout << "Files found: " << results.size() << "\n";
+    std::cout << "Files found: " << fileCount << "\n";
     std::cout << "Files in database: " << db.getFileCount() << "\n";
     std::cout << "Total size: " << std::fixed << std::setprecision(2)
               << (totalSize / 1024.0 / 1024.0) << " MB\n";
     std::cout << "Total tokens: " << totalTokens << "\n";
-    std::cout << "Unique tokens: " << uniqueTokens.size() << "\n";
     std::cout << "Indexed tokens: " << db.getTokenCount() << "\n";
 
     if (showStats) {
@@ -124,6 +451,82 @@ void crawlDirectory(const std::string &path, const std::string &dbPath,
                 << " seconds\n";
       std::cout << "Files indexed: " << indexedCount << "\n";
       std::cout << "Files skipped (unchanged): " << skippedCount << "\n";
+      std::cout << "Files skipped (same content hash): "
+                << unchangedContentCount << "\n";
+      std::cout << "Files removed (now binary): " << removedBinaryCount
+                << "\n";
+      std::cout << "Files deduplicated (shared content): " << dedupedCount
+                << "\n";
+      std::cout << "Read backend: " << reader.getBackendName() << "\n";
+      const auto &classes = contentClasses.getStats();
+      std::cout << "Content checks: " << classes.sniffed << " sniffed, "
+                << classes.hits << " cached, " << classes.binary
+                << " binary skipped\n";
+      std::cout << "Files streamed (over "
+                << (extraction.maxFileSize / 1024 / 1024)
+                << " MB): " << streamedCount << "\n";
+      const auto &build = indexBuilder.getStats();
+      double buildSeconds = build.buildTime.count() / 1e9;
+      std::cout << "Index build mode: "
+                << (buildOptions.mode == glint::BuildMode::Spimi ? "spimi"
+                                                                 : "direct")
+                << "\n";
+      std::cout << "Postings written: " << build.postingsWritten << "\n";
+      if (buildOptions.contentTrigrams) {
+        std::cout << "Content trigrams written: " << build.trigramsWritten
+                  << "\n";
+      }
+      if (buildSeconds > 0) {
+        std::cout << "Index throughput: " << std::fixed << std::setprecision(1)
+                  << (build.postingsWritten / buildSeconds)
+                  << " postings/second\n";
+      }
+      if (buildOptions.mode == glint::BuildMode::Spimi) {
+        std::cout << "Runs spilled: " << build.runsSpilled << " ("
+                  << std::fixed << std::setprecision(2)
+                  << (build.bytesSpilled / 1024.0 / 1024.0) << " MB)\n";
+        std::cout << "Peak inversion memory: " << std::fixed
+                  << std::setprecision(2)
+                  << (build.peakMemory / 1024.0 / 1024.0) << " MB\n";
+      }
+      std::cout << "Score bounds refreshed: " << boundsRefreshed
+                << " terms\n";
+      std::cout << "Database size: " << std::fixed << std::setprecision(2)
+                << (db.getDatabaseSize() / 1024.0 / 1024.0) << " MB (schema v"
+                << db.getSchemaVersion() << ")\n";
+      auto storage = db.getStorageStats();
+      std::cout << "Free pages: " << storage.freePages << " ("
+                << std::setprecision(1) << (storage.freeRatio() * 100.0)
+                << "%)\n";
+      if (docStore && docStore->getRawBytes() > 0) {
+        std::cout << "Document store: " << std::fixed << std::setprecision(2)
+                  << (docStore->getStoredBytes() / 1024.0 / 1024.0)
+                  << " MB stored, "
+                  << (docStore->getRawBytes() / 1024.0 / 1024.0)
+                  << " MB normalized text\n";
+      }
+      if (docStore) {
+        printDocumentStore(docStore->getStats(), true);
+      }
+      std::cout << "Memory limit: " << (memory.getLimit() / 1024 / 1024)
+                << " MB (" << batchCount << " crawl batch(es))\n";
+      for (auto component : {glint::MemoryComponent::SqliteCache,
+                             glint::MemoryComponent::Crawler,
+                             glint::MemoryComponent::Reader,
+                             glint::MemoryComponent::Index}) {
+        if (component == glint::MemoryComponent::SqliteCache) {
+          memory.set(component, db.getCacheMemory());
+        }
+        std::cout << "  " << glint::MemoryBudget::name(component) << ": "
+                  << std::fixed << std::setprecision(2)
+                  << (memory.peak(component) / 1024.0 / 1024.0) << " of "
+                  << (memory.share(component) / 1024.0 / 1024.0)
+                  << " MB peak\n";
+      }
+      auto checkpoints = db.getCheckpointStats();
+      std::cout << "WAL checkpoints: " << checkpoints.passive << " passive, "
+                << checkpoints.truncate << " truncate, " << checkpoints.busy
+                << " busy\n";
       if (duration.count() > 0) {
         double filesPerSec = (fileCount * 1000.0) / duration.count();
         std::cout << "Processing rate: " << std::fixed << std::setprecision(1)
@@ -132,44 +535,525 @@ void crawlDirectory(const std::string &path, const std::string &dbPath,
     }
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+int mergeIndexes(const std::string &outPath,
+                 const std::vector<std::string> &inputs, bool useDocStore,
+                 bool showStats) {
+  auto startTime = std::chrono::steady_clock::now();
+
+  std::cout << "Merging " << inputs.size() << " index(es) into: " << outPath
+            << "\n\n";
+
+  try {
+    glint::Database db(outPath);
+    db.initialize();
+
+    std::unique_ptr<glint::DocumentStore> docStore;
+    if (useDocStore) {
+      docStore = std::make_unique<glint::DocumentStore>(
+          db, glint::DocumentStore::pathFor(outPath));
+    }
+
+    for (const auto &input : inputs) {
+      std::error_code error;
+      if (!std::filesystem::exists(input)) {
+        std::cerr << "Error: index not found: " << input << "\n";
+        return 1;
+      }
+      if (std::filesystem::equivalent(input, outPath, error)) {
+        std::cerr << "Error: cannot merge " << input << " into itself\n";
+        return 1;
+      }
+
+      auto stats = db.mergeFrom(input);
+
+      size_t documents = 0;
+      auto sourceDocs = glint::DocumentStore::pathFor(input);
+      if (docStore && !stats.documents.empty() &&
+          std::filesystem::exists(sourceDocs)) {
+        glint::Database source(input);
+        glint::DocumentStore sourceStore(source, sourceDocs);
+        for (const auto &[sourceId, targetId] : stats.documents) {
+          std::string text = sourceStore.read(sourceId);
+          if (!text.empty()) {
+            docStore->add(targetId, text);
+            documents++;
+          }
+        }
+        docStore->flush();
+      }
+
+      std::cout << input << ": " << stats.filesAdded << " added, "
+                << stats.filesReplaced << " replaced, " << stats.filesSkipped
+                << " skipped (not newer), " << stats.postingsMerged
+                << " postings, " << documents << " documents\n";
+    }
+
+    size_t boundsRefreshed = db.refreshScoreBounds();
+
+    std::cout << "\nMerge complete!\n";
+    std::cout << "Files in database: " << db.getFileCount() << "\n";
+    std::cout << "Indexed tokens: " << db.getTokenCount() << "\n";
+
+    if (showStats) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - startTime);
+      std::cout << "\nPerformance Statistics:\n";
+      std::cout << "Time elapsed: " << (elapsed.count() / 1000.0)
+                << " seconds\n";
+      std::cout << "Score bounds refreshed: " << boundsRefreshed
+                << " terms\n";
+      std::cout << "Database size: " << std::fixed << std::setprecision(2)
+                << (db.getDatabaseSize() / 1024.0 / 1024.0) << " MB\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
   }
+
+  return 0;
+}
+
+void benchmarkReads(const std::string &path) {
+  glint::DirectoryCrawler crawler(path);
+  auto files = crawler.crawl();
+
+  std::vector<glint::ReadRequest> requests;
+  std::uintmax_t totalBytes = 0;
+  for (const auto &file : files) {
+    if (file.size > 0 && file.size <= glint::TextExtractor::MAX_FILE_SIZE) {
+      requests.push_back({file.path, static_cast<size_t>(file.size)});
+      totalBytes += file.size;
+    }
+  }
+
+  std::cout << "Read benchmark: " << requests.size() << " files, "
+            << std::fixed << std::setprecision(2)
+            << (totalBytes / 1024.0 / 1024.0) << " MB\n\n";
+  if (requests.empty()) {
+    return;
+  }
+
+  auto evict = [&] {
+#ifndef _WIN32
+    for (const auto &request : requests) {
+      int fd = ::open(request.path.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+      }
+    }
+#endif
+  };
+
+  auto report = [&](const std::string &label, bool cold, auto &&run) {
+    if (cold) {
+      evict();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::uintmax_t bytes = run();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::cout << std::left << std::setw(38)
+              << (label + (cold ? " (cold)" : " (warm)")) << std::right
+              << std::fixed << std::setprecision(1) << std::setw(10)
+              << (requests.size() / seconds) << " files/s" << std::setw(10)
+              << (bytes / 1024.0 / 1024.0 / seconds) << " MB/s\n";
+  };
+
+  auto runExtractText = [&] {
+    std::uintmax_t bytes = 0;
+    for (const auto &request : requests) {
+      bytes += glint::TextExtractor::extractText(request.path).size();
+    }
+    return bytes;
+  };
+
+  glint::BatchReader ringReader;
+  glint::BatchReaderOptions threadOptions;
+  threadOptions.allowIoUring = false;
+  glint::BatchReader threadReader(threadOptions);
+
+  auto runBatch = [&](glint::BatchReader &reader) {
+    return [&reader, &requests] {
+      std::uintmax_t bytes = 0;
+      reader.readAll(requests,
+                     [&](size_t, std::string &&data, int) {
+                       bytes += data.size();
+                     });
+      return bytes;
+    };
+  };
+
+  runExtractText();
+  for (bool cold : {false, true}) {
+    report("TextExtractor::extractText", cold, runExtractText);
+    report(std::string("BatchReader ") + ringReader.getBackendName(), cold,
+           runBatch(ringReader));
+    if (ringReader.getBackend() != threadReader.getBackend()) {
+      report("BatchReader thread pool", cold, runBatch(threadReader));
+    }
+  }
+}
+
+void benchmarkSearch(const std::string &dbPath) {
+  const size_t topK = 20;
+  const int repetitions = 5;
+
+  glint::Database db(dbPath);
+  db.initialize();
+
+  std::unique_ptr<glint::DocumentStore> docStore;
+  auto docStorePath = glint::DocumentStore::pathFor(dbPath);
+  if (std::filesystem::exists(docStorePath)) {
+    docStore = std::make_unique<glint::DocumentStore>(db, docStorePath);
+  }
+
+  glint::SearchEngine searchEngine(db, docStore.get());
+
+  auto common = db.getFrequentTokens(8);
+  if (common.size() < 8) {
+    std::cerr << "Error: --bench-search needs an index with at least 8 "
+                 "terms\n";
+    return;
+  }
+
+  std::vector<std::string> queries = {
+      common[0].first,
+      common[0].first + " " + common[1].first,
+      common[2].first + " " + common[3].first + " " + common[4].first,
+      common[5].first + " " + common[6].first + " " + common[7].first + " " +
+          common[0].first,
+      common[1].first + " " + common[3].first + " NOT " + common[2].first,
+  };
+
+  std::cout << "Search benchmark: top " << topK << ", " << repetitions
+            << " runs per query\n";
+  std::cout << "Most common term: " << common[0].first << " ("
+            << common[0].second << " files)\n\n";
+
+  auto run = [&](const std::string &query, bool pruning,
+                 glint::SearchStats &stats, double &millis,
+                 double &scoringMillis) {
+    glint::SearchOptions options;
+    options.limit = topK;
+    options.pruning = pruning;
+    options.stats = &stats;
+
+    std::vector<glint::SearchResult> results;
+    scoringMillis = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+      results = searchEngine.search(query, options);
+      scoringMillis +=
+          std::chrono::duration<double, std::milli>(stats.scoringTime).count();
+    }
+    scoringMillis /= repetitions;
+    millis = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count() /
+             repetitions;
+    return results;
+  };
+
+  double totalExhaustive = 0;
+  double totalPruned = 0;
+  double scoringExhaustive = 0;
+  double scoringPruned = 0;
+  bool allIdentical = true;
+
+  for (const auto &query : queries) {
+    glint::SearchStats exhaustiveStats;
+    glint::SearchStats prunedStats;
+    double exhaustiveMs = 0;
+    double prunedMs = 0;
+    double exhaustiveScoringMs = 0;
+    double prunedScoringMs = 0;
+
+    auto expected = run(query, false, exhaustiveStats, exhaustiveMs,
+                        exhaustiveScoringMs);
+    auto actual =
+        run(query, true, prunedStats, prunedMs, prunedScoringMs);
+
+    bool identical = expected.size() == actual.size();
+    for (size_t i = 0; identical && i < expected.size(); ++i) {
+      identical = expected[i].filePath == actual[i].filePath &&
+                  expected[i].score == actual[i].score;
+    }
+    allIdentical = allIdentical && identical;
+    totalExhaustive += exhaustiveMs;
+    totalPruned += prunedMs;
+    scoringExhaustive += exhaustiveScoringMs;
+    scoringPruned += prunedScoringMs;
+
+    std::cout << "\"" << query << "\"\n";
+    std::cout << "  exhaustive: " << std::fixed << std::setprecision(2)
+              << exhaustiveMs << " ms (scoring " << exhaustiveScoringMs
+              << " ms), " << exhaustiveStats.documentsScored
+              << " documents scored\n";
+    std::cout << "  pruned:     " << std::fixed << std::setprecision(2)
+              << prunedMs << " ms (scoring " << prunedScoringMs
+              << " ms), " << prunedStats.documentsScored
+              << " documents scored, " << prunedStats.blocksSkipped
+              << " blocks skipped"
+              << (prunedStats.pruned ? "" : " (bounds unavailable)") << "\n";
+    std::cout << "  results " << (identical ? "identical" : "DIFFER") << "\n";
+  }
+
+  std::cout << "\nTotal: exhaustive " << std::fixed << std::setprecision(2)
+            << totalExhaustive << " ms, pruned " << totalPruned << " ms";
+  std::cout << "\nScoring: exhaustive " << scoringExhaustive << " ms, pruned "
+            << scoringPruned << " ms";
+  if (scoringPruned > 0) {
+    std::cout << " (" << std::setprecision(1)
+              << (scoringExhaustive / scoringPruned) << "x)";
+  }
+  std::cout << "\n";
+  if (!allIdentical) {
+    std::cerr << "Error: pruned results differ from exhaustive evaluation\n";
+  }
+}
+
+void findFiles(const std::string &substring, const std::string &dbPath) {
+  try {
+    glint::Database db(dbPath);
+    db.initialize();
+    auto paths = db.findPaths(substring);
+
+    if (paths.empty()) {
+      std::cout << "No matching paths.\n";
+      return;
+    }
+
+    std::sort(paths.begin(), paths.end());
+    for (const auto &path : paths) {
+      std::cout << path << "\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+  }
+}
+
+void regexSearch(const std::string &pattern, const std::string &dbPath,
+                 size_t limit, bool ignoreCase, bool verbose) {
+  try {
+    glint::Database db(dbPath);
+    db.initialize();
+    glint::RegexSearch search(db);
+
+    glint::RegexSearchStats stats;
+    glint::RegexSearchOptions options;
+    options.limit = limit;
+    options.ignoreCase = ignoreCase;
+    options.stats = &stats;
+    auto matches = search.search(pattern, options);
+
+    for (const auto &match : matches) {
+      for (const auto &[line, text] : match.lines) {
+        std::cout << match.filePath << ":" << line << ":" << text << "\n";
+      }
+    }
+
+    if (verbose) {
+      std::cerr << "Trigram plan: " << stats.plan << "\n";
+      std::cerr << "Candidates: " << stats.candidates << " ("
+                << stats.unindexed << " without trigrams), "
+                << stats.filesRead << " read, " << matches.size()
+                << " matched\n";
+    }
+    if (stats.unindexed > 0 && stats.unindexed == stats.candidates) {
+      std::cerr << "Note: no content trigrams indexed; crawl with "
+                   "--trigrams to avoid scanning every file.\n";
+    }
+    if (stats.linesSkipped > 0) {
+      std::cerr << "Note: " << stats.linesSkipped
+                << " line(s) longer than "
+                << glint::RegexSearch::MAX_LINE_LENGTH / 1024
+                << " KB were not searched.\n";
+    }
+    if (stats.truncated) {
+      std::cerr << "... stopped after " << limit
+                << " matching file(s); raise --limit for more\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+  }
+}
+
+void runTui(const std::string &dbPath) {
+  try {
+    glint::Database db(dbPath);
+    db.initialize();
+
+    std::unique_ptr<glint::DocumentStore> docStore;
+    auto docStorePath = glint::DocumentStore::pathFor(dbPath);
+    if (std::filesystem::exists(docStorePath)) {
+      docStore = std::make_unique<glint::DocumentStore>(db, docStorePath);
+    }
+
+    glint::PostingsCache postingsCache;
+    glint::SearchEngine searchEngine(db, docStore.get(), &postingsCache);
+    glint::SearchTui tui(searchEngine);
+    std::string chosen = tui.run();
+    if (!chosen.empty()) {
+      std::cout << chosen << "\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+  }
+}
+
+void printStorage(const char *label, const glint::StorageStats &storage) {
+  std::cout << label << ": " << std::fixed << std::setprecision(2)
+            << (storage.pageCount * storage.pageSize / 1024.0 / 1024.0)
+            << " MB, " << storage.freePages << " free pages ("
+            << std::setprecision(1) << (storage.freeRatio() * 100.0) << "%)";
+  if (storage.fragmentation) {
+    std::cout << ", " << (*storage.fragmentation * 100.0)
+              << "% leaf pages out of order";
+  }
+  std::cout << "\n";
+}
+
+int maintainDatabase(const std::string &dbPath,
+                     const glint::MaintenanceOptions &options, bool full) {
+  try {
+    glint::Database db(dbPath);
+    db.initialize();
+    printStorage("Before", db.getStorageStats(true));
+
+    if (full) {
+      auto start = std::chrono::steady_clock::now();
+      db.vacuum();
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start);
+      std::cout << "Vacuumed in " << elapsed.count() << " ms\n";
+    } else {
+      auto storage = db.getStorageStats();
+      if (!storage.incrementalVacuum) {
+        std::cout << "Incremental vacuum is off for this database; run "
+                     "--vacuum once to enable it.\n";
+      } else if (storage.freeRatio() < options.minFreeRatio) {
+        std::cout << "Free space is below " << std::setprecision(0)
+                  << (options.minFreeRatio * 100.0)
+                  << "%; nothing to reclaim.\n";
+      } else {
+        auto stats = db.optimizeDatabase(options);
+        std::cout << "Reclaimed " << stats.pagesReclaimed << " pages in "
+                  << stats.steps << " step(s), " << stats.elapsed.count()
+                  << " ms (" << stats.throttled.count()
+                  << " ms throttled)\n";
+      }
+    }
+
+    printStorage("After", db.getStorageStats(true));
+
+    auto docStorePath = glint::DocumentStore::pathFor(dbPath);
+    if (std::filesystem::exists(docStorePath)) {
+      glint::DocumentStore docStore(db, docStorePath);
+      auto stats = docStore.getStats();
+      printDocumentStore(stats, false);
+      if (full ||
+          stats.deadRatio() >= glint::DocumentStore::COMPACT_DEAD_RATIO) {
+        auto reclaimed = docStore.compact();
+        if (!reclaimed) {
+          std::cout << "Document store is open in another process; "
+                       "compact it when no crawl or search is running.\n";
+        } else {
+          std::cout << "Compacted document store: " << std::fixed
+                    << std::setprecision(2)
+                    << (*reclaimed / 1024.0 / 1024.0) << " MB reclaimed\n";
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
 }
 
 void searchFiles(const std::string &query, const std::string &dbPath,
-                 const std::string &fileType) {
+                 const std::string &fileType, const std::string &directory,
+                 size_t limit, size_t page, bool verbose) {
   std::cout << "Searching for: " << query << "\n";
   std::cout << "Database: " << dbPath << "\n";
   if (!fileType.empty()) {
     std::cout << "File type filter: " << fileType << "\n";
   }
+  if (!directory.empty()) {
+    std::cout << "Directory: " << directory << "\n";
+  }
   std::cout << "\n";
 
   try {
     glint::Database db(dbPath);
-    glint::SearchEngine searchEngine(db);
+    db.initialize();
+
+    std::unique_ptr<glint::DocumentStore> docStore;
+    auto docStorePath = glint::DocumentStore::pathFor(dbPath);
+    if (std::filesystem::exists(docStorePath)) {
+      docStore = std::make_unique<glint::DocumentStore>(db, docStorePath);
+    }
 
-    auto results = searchEngine.search(query, fileType);
+    glint::SearchEngine searchEngine(db, docStore.get());
 
-    if (results.empty()) {
-      std::cout << "No results found.\n";
+    glint::SearchOptions options;
+    options.fileTypeFilter = fileType;
+    options.directory = directory;
+    options.limit = limit;
+    options.offset = (page - 1) * limit;
+    glint::SearchStats stats;
+    options.stats = &stats;
+    auto result = searchEngine.searchPage(query, options);
+
+    if (verbose) {
+      std::cout << "Query plan:\n";
+      for (size_t step = 0; step < stats.plan.size(); ++step) {
+        std::cout << "  " << (step + 1) << ". " << stats.plan[step] << "\n";
+      }
+      if (!stats.pruned) {
+        std::cout << "Postings read: " << stats.postingsRead << "\n";
+      }
+      std::cout << "\n";
+    }
+
+    if (result.results.empty()) {
+      if (page > 1 && result.totalHits > 0) {
+        std::cout << "No results on page " << page << ".\n";
+      } else {
+        std::cout << "No results found.\n";
+      }
       return;
     }
 
-    std::cout << "Found " << results.size() << " result(s):\n\n";
+    std::cout << "Found " << (result.totalIsEstimate ? "about " : "")
+              << result.totalHits << " matching file(s), showing "
+              << (options.offset + 1) << "-"
+              << (options.offset + result.results.size()) << ":\n\n";
 
-    int rank = 1;
-    for (const auto &result : results) {
-      std::cout << rank << ". " << result.filePath
-                << " (score: " << result.score << ")\n";
-      if (!result.preview.empty()) {
-        std::cout << "   " << result.preview << "\n";
+    size_t rank = options.offset + 1;
+    for (const auto &hit : result.results) {
+      std::cout << rank << ". " << hit.filePath << " (score: " << hit.score
+                << ")\n";
+      if (!hit.preview.empty()) {
+        std::cout << "   " << hit.preview << "\n";
       }
       std::cout << "\n";
       rank++;
-      if (rank > 20) {
-        std::cout << "... and " << (results.size() - 20) << " more results\n";
-        break;
-      }
+    }
+
+    if (result.next) {
+      std::cout << "... more results with --page " << (page + 1) << "\n";
     }
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << "\n";
@@ -185,11 +1069,30 @@ int main(int argc, char *argv[]) {
   }
 
   std::string crawlPath;
+  std::string mergeOutput;
+  std::vector<std::string> mergeInputs;
   std::string searchQuery;
+  std::string findQuery;
+  std::string regexPattern;
   std::string dbPath = "glint.db";
   std::string fileType;
+  std::string directory;
+  size_t limit = 20;
+  size_t page = 1;
+  glint::IndexBuildOptions buildOptions;
+  glint::ExtractionPolicy extraction;
+  extraction.oversize = glint::OversizePolicy::Stream;
+  glint::MaintenanceOptions maintenance;
+  size_t memoryLimit = glint::MemoryBudget::DEFAULT_LIMIT;
+  bool useDocStore = true;
   bool verbose = false;
   bool showStats = false;
+  bool benchSearch = false;
+  bool tui = false;
+  bool maintain = false;
+  bool fullVacuum = false;
+  bool ignoreCase = false;
+  bool resume = true;
 
   for (size_t i = 0; i < args.size(); ++i) {
     const auto &arg = args[i];
@@ -211,6 +1114,19 @@ int main(int argc, char *argv[]) {
         return 1;
       }
     }
+    if (arg == "--merge") {
+      if (i + 2 < args.size()) {
+        mergeOutput = args[++i];
+        while (i + 1 < args.size() && args[i + 1].rfind("--", 0) != 0) {
+          mergeInputs.push_back(args[++i]);
+        }
+      }
+      if (mergeInputs.empty()) {
+        std::cerr << "Error: --merge requires an output and at least one "
+                     "input database\n";
+        return 1;
+      }
+    }
     if (arg == "--search") {
       if (i + 1 < args.size()) {
         searchQuery = args[i + 1];
@@ -220,6 +1136,27 @@ int main(int argc, char *argv[]) {
         return 1;
       }
     }
+    if (arg == "--find") {
+      if (i + 1 < args.size()) {
+        findQuery = args[i + 1];
+        ++i;
+      } else {
+        std::cerr << "Error: --find requires a substring\n";
+        return 1;
+      }
+    }
+    if (arg == "--regex") {
+      if (i + 1 < args.size()) {
+        regexPattern = args[i + 1];
+        ++i;
+      } else {
+        std::cerr << "Error: --regex requires a pattern\n";
+        return 1;
+      }
+    }
+    if (arg == "--ignore-case") {
+      ignoreCase = true;
+    }
     if (arg == "--db") {
       if (i + 1 < args.size()) {
         dbPath = args[i + 1];
@@ -238,6 +1175,113 @@ int main(int argc, char *argv[]) {
         return 1;
       }
     }
+    if (arg == "--under") {
+      if (i + 1 < args.size()) {
+        directory = args[i + 1];
+        ++i;
+      } else {
+        std::cerr << "Error: --under requires a directory path\n";
+        return 1;
+      }
+    }
+    if (arg == "--limit") {
+      auto value = numberArgument(args, i, "a number from 1 to 1000000000",
+                                  1, MAX_PAGE_OFFSET);
+      if (!value) {
+        return 1;
+      }
+      limit = *value;
+    }
+    if (arg == "--page") {
+      auto value = numberArgument(args, i, "a number from 1 to 1000000000",
+                                  1, MAX_PAGE_OFFSET);
+      if (!value) {
+        return 1;
+      }
+      page = *value;
+    }
+    if (arg == "--build-mode") {
+      if (i + 1 < args.size() &&
+          (args[i + 1] == "direct" || args[i + 1] == "spimi")) {
+        buildOptions.mode = args[i + 1] == "spimi" ? glint::BuildMode::Spimi
+                                                   : glint::BuildMode::Direct;
+        ++i;
+      } else {
+        std::cerr << "Error: --build-mode requires 'direct' or 'spimi'\n";
+        return 1;
+      }
+    }
+    if (arg == "--index-memory") {
+      auto value = numberArgument(args, i, "a size in MB");
+      if (!value) {
+        return 1;
+      }
+      buildOptions.memoryBudget = *value * 1024 * 1024;
+    }
+    if (arg == "--memory-limit") {
+      auto value = numberArgument(args, i, "a size in MB", 1);
+      if (!value) {
+        return 1;
+      }
+      memoryLimit = *value * 1024 * 1024;
+    }
+    if (arg == "--max-file-size") {
+      auto value = numberArgument(args, i, "a size in MB");
+      if (!value) {
+        return 1;
+      }
+      extraction.maxFileSize = *value * 1024 * 1024;
+    }
+    if (arg == "--oversize") {
+      if (i + 1 < args.size() && args[i + 1] == "skip") {
+        extraction.oversize = glint::OversizePolicy::Skip;
+      } else if (i + 1 < args.size() && args[i + 1] == "truncate") {
+        extraction.oversize = glint::OversizePolicy::Truncate;
+      } else if (i + 1 < args.size() && args[i + 1] == "stream") {
+        extraction.oversize = glint::OversizePolicy::Stream;
+      } else {
+        std::cerr << "Error: --oversize requires 'skip', 'truncate' or "
+                     "'stream'\n";
+        return 1;
+      }
+      ++i;
+    }
+    if (arg == "--trigrams") {
+      buildOptions.contentTrigrams = true;
+    }
+    if (arg == "--restart") {
+      resume = false;
+    }
+    if (arg == "--no-docstore") {
+      useDocStore = false;
+    }
+    if (arg == "--bench-read") {
+      if (i + 1 < args.size()) {
+        benchmarkReads(args[i + 1]);
+        return 0;
+      }
+      std::cerr << "Error: --bench-read requires a directory path\n";
+      return 1;
+    }
+    if (arg == "--tui") {
+      tui = true;
+    }
+    if (arg == "--maintain") {
+      maintain = true;
+    }
+    if (arg == "--vacuum") {
+      fullVacuum = true;
+    }
+    if (arg == "--io-budget") {
+      auto value = numberArgument(args, i, "a rate in MB/s");
+      if (!value) {
+        return 1;
+      }
+      maintenance.ioBytesPerSecond = *value * 1024 * 1024;
+    }
+    if (arg == "--bench-search") {
+      benchSearch = true;
+    }
     if (arg == "--verbose") {
       verbose = true;
     }
@@ -247,12 +1291,47 @@ int main(int argc, char *argv[]) {
   }
 
   if (!crawlPath.empty()) {
-    crawlDirectory(crawlPath, dbPath, verbose, showStats);
+    return crawlDirectory(crawlPath, dbPath, buildOptions, extraction,
+                          memoryLimit, useDocStore, resume, verbose,
+                          showStats);
+  }
+
+  if (!mergeOutput.empty()) {
+    return mergeIndexes(mergeOutput, mergeInputs, useDocStore, showStats);
+  }
+
+  if (maintain || fullVacuum) {
+    return maintainDatabase(dbPath, maintenance, fullVacuum);
+  }
+
+  if (benchSearch) {
+    try {
+      benchmarkSearch(dbPath);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (tui) {
+    runTui(dbPath);
+    return 0;
+  }
+
+  if (!findQuery.empty()) {
+    findFiles(findQuery, dbPath);
+    return 0;
+  }
+
+  if (!regexPattern.empty()) {
+    regexSearch(regexPattern, dbPath, limit, ignoreCase, verbose);
     return 0;
   }
 
   if (!searchQuery.empty()) {
-    searchFiles(searchQuery, dbPath, fileType);
+    searchFiles(searchQuery, dbPath, fileType, directory, limit, page,
+                verbose);
     return 0;
   }
 
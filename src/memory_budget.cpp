@@ -0,0 +1,54 @@
+#include "glint/memory_budget.h"
+
+namespace glint {
+
+namespace {
+
+// Percent of the limit each component may hold, in MemoryComponent order.
+constexpr size_t SHARES[MemoryBudget::COMPONENT_COUNT] = {25, 10, 25, 40};
+
+constexpr const char *NAMES[MemoryBudget::COMPONENT_COUNT] = {
+    "sqlite cache", "crawler", "reader", "index"};
+
+} // namespace
+
+MemoryBudget::MemoryBudget(size_t limit) : limit_(limit) {}
+
+size_t MemoryBudget::share(MemoryComponent component) const {
+  return limit_ / 100 * SHARES[static_cast<size_t>(component)];
+}
+
+void MemoryBudget::charge(MemoryComponent component, size_t bytes) {
+  auto &account = accounts_[static_cast<size_t>(component)];
+  notePeak(account, account.used.fetch_add(bytes) + bytes);
+}
+
+void MemoryBudget::release(MemoryComponent component, size_t bytes) {
+  accounts_[static_cast<size_t>(component)].used.fetch_sub(bytes);
+}
+
+void MemoryBudget::set(MemoryComponent component, size_t bytes) {
+  auto &account = accounts_[static_cast<size_t>(component)];
+  account.used = bytes;
+  notePeak(account, bytes);
+}
+
+size_t MemoryBudget::used(MemoryComponent component) const {
+  return accounts_[static_cast<size_t>(component)].used;
+}
+
+size_t MemoryBudget::peak(MemoryComponent component) const {
+  return accounts_[static_cast<size_t>(component)].peak;
+}
+
+const char *MemoryBudget::name(MemoryComponent component) {
+  return NAMES[static_cast<size_t>(component)];
+}
+
+void MemoryBudget::notePeak(Account &account, size_t value) {
+  size_t peak = account.peak;
+  while (value > peak && !account.peak.compare_exchange_weak(peak, value)) {
+  }
+}
+
+} // namespace glint
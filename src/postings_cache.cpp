@@ -0,0 +1,173 @@
+#include "glint/postings_cache.h"
+#include <algorithm>
+#include <functional>
+
+namespace glint {
+
+namespace {
+
+constexpr size_t ENTRY_OVERHEAD = 96;
+constexpr unsigned MAX_COUNT = 15;
+constexpr unsigned MIN_WANTED_COUNT = 2;
+constexpr size_t MAX_ENTRY_SHARE = 4;
+
+constexpr std::array<uint64_t, PostingsCache::SKETCH_DEPTH> SEEDS = {
+    0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull,
+    0xd6e8feb86659fd93ull};
+
+size_t sketchIndex(size_t hash, size_t row) {
+  uint64_t mixed = (static_cast<uint64_t>(hash) + row) * SEEDS[row];
+  return static_cast<size_t>(mixed >> 32) % PostingsCache::SKETCH_WIDTH;
+}
+
+size_t entryBytes(const std::string &token,
+                  const PostingsCache::Postings &postings) {
+  return postings.capacity() * sizeof(postings[0]) + token.size() +
+         ENTRY_OVERHEAD;
+}
+
+} // namespace
+
+PostingsCache::PostingsCache(size_t capacity) : capacity_(capacity) {
+  for (auto &row : sketch_) {
+    row.assign(SKETCH_WIDTH, 0);
+  }
+}
+
+uint64_t PostingsCache::ticket() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return epoch_;
+}
+
+PostingsCache::Entry PostingsCache::find(const std::string &token) {
+  size_t hash = std::hash<std::string>{}(token);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  record(hash);
+
+  auto it = slots_.find(token);
+  if (it == slots_.end()) {
+    stats_.misses++;
+    return nullptr;
+  }
+
+  recency_.splice(recency_.begin(), recency_, it->second.recency);
+  stats_.hits++;
+  return it->second.postings;
+}
+
+bool PostingsCache::wanted(const std::string &token) const {
+  size_t hash = std::hash<std::string>{}(token);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_ > 0 && estimate(hash) >= MIN_WANTED_COUNT;
+}
+
+// Postings read under a snapshot older than an invalidation must not be
+// cached, so callers take a ticket before their read transaction starts.
+PostingsCache::Entry PostingsCache::insert(const std::string &token,
+                                           Postings postings,
+                                           uint64_t ticket) {
+  size_t bytes = entryBytes(token, postings);
+  size_t hash = std::hash<std::string>{}(token);
+  auto entry = std::make_shared<const Postings>(std::move(postings));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ticket != epoch_ || bytes > capacity_ / MAX_ENTRY_SHARE) {
+    stats_.rejected++;
+    return entry;
+  }
+
+  auto existing = slots_.find(token);
+  if (existing != slots_.end()) {
+    return existing->second.postings;
+  }
+
+  unsigned frequency = estimate(hash);
+  size_t victims = 0;
+  size_t freed = capacity_ - bytes_;
+  for (auto it = recency_.rbegin(); freed < bytes && it != recency_.rend();
+       ++it) {
+    if (estimate(std::hash<std::string>{}(*it)) >= frequency) {
+      stats_.rejected++;
+      return entry;
+    }
+    freed += slots_[*it].bytes;
+    victims++;
+  }
+
+  for (; victims > 0; --victims) {
+    auto victim = slots_.find(recency_.back());
+    bytes_ -= victim->second.bytes;
+    slots_.erase(victim);
+    recency_.pop_back();
+    stats_.evicted++;
+  }
+
+  recency_.push_front(token);
+  slots_[token] = {entry, bytes, recency_.begin()};
+  bytes_ += bytes;
+  stats_.admitted++;
+  return entry;
+}
+
+void PostingsCache::invalidate(const std::string &token) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  epoch_++;
+
+  auto it = slots_.find(token);
+  if (it == slots_.end()) {
+    return;
+  }
+  bytes_ -= it->second.bytes;
+  recency_.erase(it->second.recency);
+  slots_.erase(it);
+  stats_.invalidated++;
+}
+
+void PostingsCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  epoch_++;
+  stats_.invalidated += slots_.size();
+  slots_.clear();
+  recency_.clear();
+  bytes_ = 0;
+}
+
+PostingsCacheStats PostingsCache::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PostingsCacheStats stats = stats_;
+  stats.entries = slots_.size();
+  stats.bytes = bytes_;
+  return stats;
+}
+
+// Count-min sketch of recent requests. Counters saturate at 15 and are
+// halved every ten sketch widths of samples so that popularity ages out.
+void PostingsCache::record(size_t hash) {
+  for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+    auto &counter = sketch_[row][sketchIndex(hash, row)];
+    if (counter < MAX_COUNT) {
+      counter++;
+    }
+  }
+
+  if (++samples_ >= 10 * SKETCH_WIDTH) {
+    for (auto &row : sketch_) {
+      for (auto &counter : row) {
+        counter /= 2;
+      }
+    }
+    samples_ /= 2;
+  }
+}
+
+unsigned PostingsCache::estimate(size_t hash) const {
+  unsigned count = MAX_COUNT;
+  for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+    count = std::min<unsigned>(count, sketch_[row][sketchIndex(hash, row)]);
+  }
+  return count;
+}
+
+} // namespace glint
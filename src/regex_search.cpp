@@ -0,0 +1,224 @@
+#include "glint/regex_search.h"
+#include "glint/text_extractor.h"
+#include "glint/trigram.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <regex>
+#include <unordered_map>
+
+namespace glint {
+
+namespace {
+
+using TrigramLists = std::unordered_map<uint32_t, std::vector<int>>;
+
+std::vector<int> intersect(const std::vector<int> &a,
+                           const std::vector<int> &b) {
+  std::vector<int> result;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(result));
+  return result;
+}
+
+std::vector<int> unite(const std::vector<int> &a, const std::vector<int> &b) {
+  std::vector<int> result;
+  std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                 std::back_inserter(result));
+  return result;
+}
+
+const std::vector<int> &trigramFiles(const Database &db, TrigramLists &lists,
+                                     uint32_t trigram) {
+  auto it = lists.find(trigram);
+  if (it == lists.end()) {
+    it = lists.emplace(trigram, db.getContentTrigramFiles(trigram)).first;
+  }
+  return it->second;
+}
+
+// Files that may match the query, restricted to the covered set. AND nodes
+// intersect their shortest lists first and stop as soon as nothing is left.
+std::vector<int> evaluate(const Database &db, const TrigramQuery &query,
+                          const std::vector<int> &covered,
+                          TrigramLists &lists) {
+  switch (query.op) {
+  case TrigramQuery::Op::All:
+    return covered;
+  case TrigramQuery::Op::None:
+    return {};
+  case TrigramQuery::Op::And: {
+    std::vector<const std::vector<int> *> ordered;
+    for (uint32_t trigram : query.trigrams) {
+      ordered.push_back(&trigramFiles(db, lists, trigram));
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const auto *a, const auto *b) {
+      return a->size() < b->size();
+    });
+
+    std::vector<int> result = covered;
+    for (const auto *files : ordered) {
+      result = intersect(result, *files);
+      if (result.empty()) {
+        return result;
+      }
+    }
+    for (const auto &sub : query.subs) {
+      result = intersect(result, evaluate(db, sub, result, lists));
+      if (result.empty()) {
+        return result;
+      }
+    }
+    return result;
+  }
+  case TrigramQuery::Op::Or: {
+    std::vector<int> result;
+    for (uint32_t trigram : query.trigrams) {
+      result =
+          unite(result, intersect(covered, trigramFiles(db, lists, trigram)));
+    }
+    for (const auto &sub : query.subs) {
+      result = unite(result, evaluate(db, sub, covered, lists));
+    }
+    return result;
+  }
+  }
+  return {};
+}
+
+// Reads a file in chunks and reports every line matching the regex. Lines
+// longer than the limit are skipped rather than buffered and counted.
+std::vector<std::pair<size_t, std::string>>
+matchLines(const std::string &path, const std::regex &regex, size_t maxLine,
+           size_t &skipped) {
+  std::vector<std::pair<size_t, std::string>> lines;
+
+  ExtractionPolicy policy;
+  policy.maxFileSize = std::numeric_limits<size_t>::max();
+  policy.oversize = OversizePolicy::Stream;
+  policy.sniffContent = false;
+
+  std::string line;
+  size_t lineNumber = 1;
+  bool overlong = false;
+
+  auto finishLine = [&] {
+    if (overlong) {
+      skipped++;
+    } else if (std::regex_search(line, regex)) {
+      lines.emplace_back(lineNumber, line);
+    }
+    line.clear();
+    overlong = false;
+    lineNumber++;
+  };
+
+  TextExtractor::extractChunks(path, policy, [&](std::string_view chunk) {
+    size_t pos = 0;
+    while (pos < chunk.size()) {
+      size_t end = chunk.find('\n', pos);
+      size_t stop = end == std::string_view::npos ? chunk.size() : end;
+
+      if (!overlong) {
+        if (line.size() + (stop - pos) > maxLine) {
+          overlong = true;
+          line.clear();
+        } else {
+          line.append(chunk.data() + pos, stop - pos);
+        }
+      }
+
+      if (end == std::string_view::npos) {
+        break;
+      }
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      finishLine();
+      pos = end + 1;
+    }
+    return true;
+  });
+
+  if (!line.empty() || overlong) {
+    finishLine();
+  }
+
+  return lines;
+}
+
+} // namespace
+
+RegexSearch::RegexSearch(const Database &db) : db_(db) {}
+
+std::vector<RegexMatch>
+RegexSearch::search(const std::string &pattern,
+                    const RegexSearchOptions &options) const {
+  auto flags = std::regex::ECMAScript | std::regex::optimize;
+  if (options.ignoreCase) {
+    flags |= std::regex::icase;
+  }
+  std::regex regex(pattern, flags);
+
+  TrigramQuery query = TrigramQuery::fromRegex(pattern);
+
+  std::vector<int> candidates;
+  std::vector<int> unindexed;
+  std::vector<std::pair<std::string, int>> ordered;
+  {
+    Database::ReadTransaction transaction(db_);
+    TrigramLists lists;
+
+    std::vector<int> covered = db_.getTrigramCoveredFiles();
+    candidates = evaluate(db_, query, covered, lists);
+    unindexed = db_.getFilesWithoutTrigrams();
+    candidates = unite(candidates, unindexed);
+
+    for (int fileId : candidates) {
+      ordered.emplace_back(db_.getFilePath(fileId), fileId);
+    }
+  }
+  std::sort(ordered.begin(), ordered.end());
+
+  RegexSearchStats stats;
+  stats.plan = query.toString();
+  stats.candidates = candidates.size();
+  stats.unindexed = unindexed.size();
+
+  std::vector<RegexMatch> matches;
+  size_t matchedFiles = 0;
+  for (const auto &[path, fileId] : ordered) {
+    if (options.limit > 0 && matchedFiles >= options.limit) {
+      stats.truncated = true;
+      break;
+    }
+
+    stats.filesRead++;
+    auto lines = matchLines(path, regex, MAX_LINE_LENGTH, stats.linesSkipped);
+    if (lines.empty()) {
+      continue;
+    }
+
+    matchedFiles++;
+    for (const auto &[id, copyPath] : db_.getFilesWithSameContent(fileId)) {
+      matches.push_back({copyPath, lines});
+    }
+  }
+
+  std::sort(matches.begin(), matches.end(),
+            [](const RegexMatch &a, const RegexMatch &b) {
+              return a.filePath < b.filePath;
+            });
+  matches.erase(std::unique(matches.begin(), matches.end(),
+                            [](const RegexMatch &a, const RegexMatch &b) {
+                              return a.filePath == b.filePath;
+                            }),
+                matches.end());
+
+  if (options.stats) {
+    *options.stats = stats;
+  }
+  return matches;
+}
+
+} // namespace glint
@@ -1,15 +1,39 @@
 #include "glint/search_engine.h"
+#include "glint/document_store.h"
 #include "glint/text_extractor.h"
 #include "glint/tokenizer.h"
 #include <algorithm>
 #include <cctype>
-#include <map>
+#include <chrono>
+#include <limits>
+#include <memory>
 #include <set>
 #include <sstream>
 
 namespace glint {
 
-SearchEngine::SearchEngine(Database &db) : db_(db) {}
+void SearchSession::clear() {
+  prefix_.clear();
+  expansions_.clear();
+  complete_ = false;
+  postings_.clear();
+  cachedPostings_ = 0;
+}
+
+SearchEngine::SearchEngine(Database &db, const DocumentStore *documents,
+                           PostingsCache *postingsCache)
+    : db_(db), documents_(documents), postingsCache_(postingsCache) {}
+
+std::string SearchEngine::loadText(int fileId,
+                                   const std::string &filePath) const {
+  if (documents_) {
+    std::string text = documents_->read(fileId);
+    if (!text.empty()) {
+      return text;
+    }
+  }
+  return TextExtractor::extractText(filePath);
+}
 
 std::string generatePreview(const std::string &text,
                             const std::vector<std::string> &queryTokens) {
@@ -63,14 +87,309 @@ bool containsPhrase(const std::string &text, const std::string &phrase) {
   return lowerText.find(lowerPhrase) != std::string::npos;
 }
 
+bool streamContainsPhrase(const std::filesystem::path &filePath,
+                          const std::string &phrase) {
+  if (phrase.empty()) {
+    return false;
+  }
+
+  std::string lowerPhrase = phrase;
+  std::transform(lowerPhrase.begin(), lowerPhrase.end(), lowerPhrase.begin(),
+                 ::tolower);
+
+  ExtractionPolicy policy;
+  policy.oversize = OversizePolicy::Stream;
+
+  std::string window;
+  bool found = false;
+  TextExtractor::extractChunks(filePath, policy, [&](std::string_view chunk) {
+    size_t appendedAt = window.size();
+    window.append(chunk);
+    std::transform(window.begin() + appendedAt, window.end(),
+                   window.begin() + appendedAt, ::tolower);
+
+    if (window.find(lowerPhrase) != std::string::npos) {
+      found = true;
+      return false;
+    }
+
+    size_t keep = lowerPhrase.size() - 1;
+    if (window.size() > keep) {
+      window.erase(0, window.size() - keep);
+    }
+    return true;
+  });
+
+  return found;
+}
+
+struct SearchEngine::ParsedQuery {
+  std::vector<std::string> phrases;
+  std::vector<std::string> andTokens;
+  std::vector<std::string> orTokens;
+  std::vector<std::string> notTokens;
+  std::vector<std::string> allTokens;
+  std::string prefix;
+  std::string directoryPrefix;
+  std::vector<std::pair<int, int>> ranges;
+  SearchSession *session = nullptr;
+  SearchStats *stats = nullptr;
+  uint64_t cacheTicket = 0;
+  bool boundsFresh = false;
+};
+
+struct SearchEngine::Candidate {
+  int fileId = -1;
+  int score = 0;
+  bool accepted = false;
+  std::vector<std::string> paths;
+  std::string text;
+};
+
+struct SearchEngine::PlannedTerm {
+  static constexpr size_t UNKNOWN = std::numeric_limits<size_t>::max();
+
+  std::string token;
+  std::optional<int64_t> tokenId;
+  std::vector<ScoreBlock> blocks;
+  size_t estimate = 0;
+};
+
+namespace {
+
+std::string directoryPrefix(const std::string &path) {
+  std::string directory = canonicalPath(path).string();
+  const char separator = std::filesystem::path::preferred_separator;
+  while (directory.size() > 1 &&
+         (directory.back() == '/' || directory.back() == separator)) {
+    directory.pop_back();
+  }
+  if (directory.empty() ||
+      (directory.back() != '/' && directory.back() != separator)) {
+    directory += separator;
+  }
+  return directory;
+}
+
+bool ranksBefore(int scoreA, int idA, int scoreB, int idB) {
+  return scoreA > scoreB || (scoreA == scoreB && idA < idB);
+}
+
+bool isAfter(const SearchCursor &cursor, int score, int fileId,
+             const std::string &filePath) {
+  if (ranksBefore(cursor.score, cursor.fileId, score, fileId)) {
+    return true;
+  }
+  return score == cursor.score && fileId == cursor.fileId &&
+         filePath > cursor.filePath;
+}
+
+using ScoredFiles = std::vector<std::pair<int, int>>;
+
+void sortByFile(ScoredFiles &postings) {
+  if (!std::is_sorted(postings.begin(), postings.end())) {
+    std::sort(postings.begin(), postings.end());
+  }
+}
+
+// Each helper walks two lists sorted by file id. Scores accumulate the
+// posting frequencies, as the exhaustive scorer always has.
+void intersectScores(ScoredFiles &scores, const ScoredFiles &postings) {
+  size_t kept = 0;
+  auto it = postings.begin();
+  for (const auto &[fileId, score] : scores) {
+    while (it != postings.end() && it->first < fileId) {
+      ++it;
+    }
+    if (it != postings.end() && it->first == fileId) {
+      scores[kept++] = {fileId, score + it->second};
+    }
+  }
+  scores.resize(kept);
+}
+
+void addScores(ScoredFiles &scores, const ScoredFiles &postings) {
+  auto it = postings.begin();
+  for (auto &[fileId, score] : scores) {
+    while (it != postings.end() && it->first < fileId) {
+      ++it;
+    }
+    if (it != postings.end() && it->first == fileId) {
+      score += it->second;
+    }
+  }
+}
+
+void uniteScores(ScoredFiles &scores, const ScoredFiles &postings) {
+  ScoredFiles merged;
+  merged.reserve(scores.size() + postings.size());
+  auto a = scores.begin();
+  auto b = postings.begin();
+  while (a != scores.end() || b != postings.end()) {
+    if (b == postings.end() || (a != scores.end() && a->first < b->first)) {
+      merged.push_back(*a++);
+    } else if (a == scores.end() || b->first < a->first) {
+      merged.push_back(*b++);
+    } else {
+      merged.emplace_back(a->first, a->second + b->second);
+      ++a;
+      ++b;
+    }
+  }
+  scores = std::move(merged);
+}
+
+void removeFiles(ScoredFiles &scores, const ScoredFiles &postings) {
+  size_t kept = 0;
+  auto it = postings.begin();
+  for (const auto &entry : scores) {
+    while (it != postings.end() && it->first < entry.first) {
+      ++it;
+    }
+    if (it == postings.end() || it->first != entry.first) {
+      scores[kept++] = entry;
+    }
+  }
+  scores.resize(kept);
+}
+
+void keepFiles(ScoredFiles &scores, const std::vector<int> &fileIds) {
+  size_t kept = 0;
+  auto it = fileIds.begin();
+  for (const auto &entry : scores) {
+    while (it != fileIds.end() && *it < entry.first) {
+      ++it;
+    }
+    if (it != fileIds.end() && *it == entry.first) {
+      scores[kept++] = entry;
+    }
+  }
+  scores.resize(kept);
+}
+
+// The part of a file-ordered postings list within [first, last].
+std::vector<std::pair<int, int>>
+postingsBetween(const std::vector<std::pair<int, int>> &postings, int first,
+                int last) {
+  auto begin = std::lower_bound(postings.begin(), postings.end(), first,
+                                [](const std::pair<int, int> &entry, int id) {
+                                  return entry.first < id;
+                                });
+  auto end = std::upper_bound(begin, postings.end(), last,
+                              [](int id, const std::pair<int, int> &entry) {
+                                return id < entry.first;
+                              });
+  return {begin, end};
+}
+
+class PostingCursor {
+public:
+  static constexpr int END = std::numeric_limits<int>::max();
+
+  PostingCursor(const Database &db, int64_t tokenId,
+                std::vector<ScoreBlock> blocks, PostingsCache::Entry cached)
+      : db_(db), tokenId_(tokenId), blocks_(std::move(blocks)),
+        cached_(std::move(cached)), blockIndex_(0), pos_(0), maxScore_(0) {
+    for (const auto &block : blocks_) {
+      maxScore_ = std::max(maxScore_, block.maxFrequency);
+    }
+    load(0, 0);
+  }
+
+  int doc() const {
+    return pos_ < postings_.size() ? postings_[pos_].first : END;
+  }
+  int frequency() const { return postings_[pos_].second; }
+  int maxScore() const { return maxScore_; }
+  size_t estimatedCount() const {
+    return blocks_.empty()
+               ? 0
+               : (blocks_.size() - 1) * Database::SCORE_BLOCK_SIZE + 1;
+  }
+
+  void next() {
+    if (++pos_ >= postings_.size()) {
+      load(blockIndex_ + 1, 0);
+    }
+  }
+
+  void advance(int target) {
+    if (doc() >= target) {
+      return;
+    }
+    if (!postings_.empty() && postings_.back().first >= target) {
+      pos_ = std::lower_bound(postings_.begin() + pos_, postings_.end(),
+                              std::make_pair(target, 0)) -
+             postings_.begin();
+      return;
+    }
+    load(findBlock(target), target);
+  }
+
+  const ScoreBlock *blockFor(int target) const {
+    size_t index = findBlock(target);
+    return index < blocks_.size() ? &blocks_[index] : nullptr;
+  }
+
+private:
+  size_t findBlock(int target) const {
+    return std::lower_bound(blocks_.begin() + blockIndex_, blocks_.end(),
+                            target,
+                            [](const ScoreBlock &block, int id) {
+                              return block.lastFileId < id;
+                            }) -
+           blocks_.begin();
+  }
+
+  void load(size_t index, int target) {
+    pos_ = 0;
+    postings_.clear();
+    for (; index < blocks_.size(); ++index) {
+      int first = index == 0 ? 0 : blocks_[index - 1].lastFileId + 1;
+      postings_ = cached_ ? postingsBetween(*cached_, std::max(first, target),
+                                            blocks_[index].lastFileId)
+                          : db_.readPostings(tokenId_, std::max(first, target),
+                                             blocks_[index].lastFileId);
+      if (!postings_.empty()) {
+        break;
+      }
+    }
+    blockIndex_ = index;
+  }
+
+  const Database &db_;
+  int64_t tokenId_;
+  std::vector<ScoreBlock> blocks_;
+  PostingsCache::Entry cached_;
+  std::vector<std::pair<int, int>> postings_;
+  size_t blockIndex_;
+  size_t pos_;
+  int maxScore_;
+};
+
+} // namespace
+
 std::vector<SearchResult> SearchEngine::search(const std::string &query) const {
-  return search(query, "");
+  return search(query, SearchOptions{});
+}
+
+std::vector<SearchResult>
+SearchEngine::search(const std::string &query,
+                     const SearchOptions &options) const {
+  return searchPage(query, options).results;
 }
 
 std::vector<SearchResult>
 SearchEngine::search(const std::string &query,
                      const std::string &fileTypeFilter) const {
-  std::vector<std::string> phrases;
+  SearchOptions options;
+  options.fileTypeFilter = fileTypeFilter;
+  return search(query, options);
+}
+
+SearchEngine::ParsedQuery
+SearchEngine::parse(const std::string &query, bool prefixLastTerm) const {
+  ParsedQuery parsed;
   std::string remainingQuery = query;
   size_t quotePos = 0;
 
@@ -79,7 +398,7 @@ SearchEngine::search(const std::string &query,
     if (endQuote != std::string::npos) {
       std::string phrase =
           remainingQuery.substr(quotePos + 1, endQuote - quotePos - 1);
-      phrases.push_back(phrase);
+      parsed.phrases.push_back(phrase);
       remainingQuery.erase(quotePos, endQuote - quotePos + 1);
     } else {
       break;
@@ -93,10 +412,12 @@ SearchEngine::search(const std::string &query,
   std::istringstream iss(remainingQuery);
   std::string word;
   std::string lastOp = "OR";
+  bool endsWithOrTerm = false;
 
   while (iss >> word) {
     if (word == "AND" || word == "OR" || word == "NOT") {
       lastOp = word;
+      endsWithOrTerm = false;
     } else {
       if (lastOp == "AND") {
         andTerms.push_back(word);
@@ -105,132 +426,715 @@ SearchEngine::search(const std::string &query,
       } else {
         orTerms.push_back(word);
       }
+      endsWithOrTerm = lastOp == "OR";
       lastOp = "OR";
     }
   }
 
-  std::vector<std::string> andTokens;
-  std::vector<std::string> orTokens;
-  std::vector<std::string> notTokens;
+  if (prefixLastTerm && endsWithOrTerm && !query.empty() &&
+      !std::isspace(static_cast<unsigned char>(query.back())) &&
+      query.back() != '"') {
+    auto tokens = Tokenizer<>::tokenize(orTerms.back());
+    if (tokens.size() == 1) {
+      parsed.prefix = tokens.front();
+      orTerms.pop_back();
+    }
+  }
 
   for (const auto &term : andTerms) {
-    auto tokens = Tokenizer::tokenize(term);
-    andTokens.insert(andTokens.end(), tokens.begin(), tokens.end());
+    auto tokens = Tokenizer<>::tokenize(term);
+    parsed.andTokens.insert(parsed.andTokens.end(), tokens.begin(),
+                            tokens.end());
   }
   for (const auto &term : orTerms) {
-    auto tokens = Tokenizer::tokenize(term);
-    orTokens.insert(orTokens.end(), tokens.begin(), tokens.end());
+    auto tokens = Tokenizer<>::tokenize(term);
+    parsed.orTokens.insert(parsed.orTokens.end(), tokens.begin(),
+                           tokens.end());
   }
   for (const auto &term : notTerms) {
-    auto tokens = Tokenizer::tokenize(term);
-    notTokens.insert(notTokens.end(), tokens.begin(), tokens.end());
+    auto tokens = Tokenizer<>::tokenize(term);
+    parsed.notTokens.insert(parsed.notTokens.end(), tokens.begin(),
+                            tokens.end());
   }
 
-  std::vector<std::string> allQueryTokens = orTokens;
-  allQueryTokens.insert(allQueryTokens.end(), andTokens.begin(),
-                        andTokens.end());
+  // A query of phrases alone still needs terms to find candidates, and
+  // every word of a phrase must be in a file that contains it.
+  if (parsed.andTokens.empty() && parsed.orTokens.empty() &&
+      parsed.prefix.empty()) {
+    for (const auto &phrase : parsed.phrases) {
+      auto tokens = Tokenizer<>::tokenize(phrase);
+      parsed.andTokens.insert(parsed.andTokens.end(), tokens.begin(),
+                              tokens.end());
+    }
+  }
 
-  if (allQueryTokens.empty() && phrases.empty()) {
-    return {};
+  parsed.allTokens = parsed.orTokens;
+  parsed.allTokens.insert(parsed.allTokens.end(), parsed.andTokens.begin(),
+                          parsed.andTokens.end());
+  if (!parsed.prefix.empty()) {
+    parsed.allTokens.push_back(parsed.prefix);
   }
 
-  std::map<int, int> fileScores;
-  std::set<int> andFileSet;
-  std::set<int> notFileSet;
+  return parsed;
+}
 
-  for (const auto &token : orTokens) {
-    auto results = db_.searchToken(token);
-    for (const auto &[fileId, frequency] : results) {
-      fileScores[fileId] += frequency;
-    }
+SearchPage SearchEngine::searchPage(const std::string &query,
+                                   const SearchOptions &options) const {
+  uint64_t cacheTicket = postingsCache_ ? postingsCache_->ticket() : 0;
+  Database::ReadTransaction snapshot(db_);
+
+  if (options.stats) {
+    *options.stats = SearchStats{};
   }
 
-  if (!andTokens.empty()) {
-    bool first = true;
-    for (const auto &token : andTokens) {
-      auto results = db_.searchToken(token);
-      std::set<int> currentSet;
-      for (const auto &[fileId, frequency] : results) {
-        currentSet.insert(fileId);
-        fileScores[fileId] += frequency;
+  ParsedQuery parsed = parse(query, options.prefixLastTerm);
+  parsed.session = options.session;
+  parsed.stats = options.stats;
+  parsed.cacheTicket = cacheTicket;
+  if (parsed.allTokens.empty() && parsed.phrases.empty()) {
+    return {};
+  }
+
+  if (!parsed.prefix.empty()) {
+    SearchSession *session = options.session;
+    std::vector<std::string> expansions;
+    bool complete = true;
+
+    if (session && session->complete_ && !session->prefix_.empty() &&
+        parsed.prefix.compare(0, session->prefix_.size(), session->prefix_) ==
+            0) {
+      for (const auto &token : session->expansions_) {
+        if (token.compare(0, parsed.prefix.size(), parsed.prefix) == 0) {
+          expansions.push_back(token);
+        }
       }
+      if (options.stats) {
+        options.stats->refined = true;
+      }
+    } else {
+      expansions =
+          db_.getTokensWithPrefix(parsed.prefix, MAX_PREFIX_EXPANSIONS + 1);
+      if (expansions.size() > MAX_PREFIX_EXPANSIONS) {
+        expansions.resize(MAX_PREFIX_EXPANSIONS);
+        complete = false;
+      }
+    }
 
-      if (first) {
-        andFileSet = currentSet;
-        first = false;
+    if (session) {
+      session->prefix_ = parsed.prefix;
+      session->expansions_ = expansions;
+      session->complete_ = complete;
+    }
+    parsed.orTokens.insert(parsed.orTokens.end(), expansions.begin(),
+                           expansions.end());
+  }
+
+  if (!options.directory.empty()) {
+    parsed.directoryPrefix = directoryPrefix(options.directory);
+    for (int fileId : db_.getDocumentsUnder(parsed.directoryPrefix)) {
+      if (!parsed.ranges.empty() && parsed.ranges.back().second + 1 == fileId) {
+        parsed.ranges.back().second = fileId;
       } else {
-        std::set<int> intersection;
-        std::set_intersection(
-            andFileSet.begin(), andFileSet.end(), currentSet.begin(),
-            currentSet.end(),
-            std::inserter(intersection, intersection.begin()));
-        andFileSet = intersection;
+        parsed.ranges.emplace_back(fileId, fileId);
       }
     }
+    if (parsed.ranges.empty()) {
+      return {};
+    }
   }
 
-  for (const auto &token : notTokens) {
-    auto results = db_.searchToken(token);
-    for (const auto &[fileId, frequency] : results) {
-      notFileSet.insert(fileId);
-    }
+  parsed.boundsFresh = !db_.hasStaleScoreBounds();
+  bool prune = options.pruning && options.limit > 0 && !options.session &&
+               parsed.andTokens.empty() && !parsed.orTokens.empty() &&
+               parsed.ranges.empty() && parsed.boundsFresh;
+  if (options.stats) {
+    options.stats->pruned = prune;
   }
 
-  std::vector<SearchResult> searchResults;
+  SearchPage page;
+  size_t matched = 0;
+  size_t depth = options.offset + options.limit + (options.after ? 2 : 1);
 
-  for (const auto &[fileId, score] : fileScores) {
-    if (notFileSet.count(fileId) > 0) {
-      continue;
+  auto scoringStart = std::chrono::steady_clock::now();
+  std::vector<Candidate> candidates =
+      prune ? scoreTopK(parsed, options, depth, matched)
+            : scoreExhaustive(parsed, options, matched);
+  if (options.stats) {
+    options.stats->scoringTime =
+        std::chrono::steady_clock::now() - scoringStart;
+  }
+
+  size_t skipped = 0;
+  bool hasMore = false;
+
+  for (auto &candidate : candidates) {
+    if (isCancelled(options)) {
+      return {};
     }
 
-    if (!andTokens.empty() && andFileSet.count(fileId) == 0) {
+    if (!candidate.accepted &&
+        !accept(candidate.fileId, parsed, options.fileTypeFilter, candidate)) {
       continue;
     }
 
-    std::string filePath = db_.getFilePath(fileId);
+    std::sort(candidate.paths.begin(), candidate.paths.end());
+    std::optional<std::string> preview;
+    for (const auto &filePath : candidate.paths) {
+      if (options.after && !isAfter(*options.after, candidate.score,
+                                    candidate.fileId, filePath)) {
+        continue;
+      }
+      if (skipped < options.offset) {
+        skipped++;
+        continue;
+      }
+      if (options.limit > 0 && page.results.size() == options.limit) {
+        hasMore = true;
+        break;
+      }
+
+      if (!preview) {
+        preview.emplace();
+        if (options.previews) {
+          if (candidate.text.empty()) {
+            candidate.text =
+                loadText(candidate.fileId, candidate.paths.front());
+          }
+          *preview = generatePreview(candidate.text, parsed.allTokens);
+        }
+      }
+      page.results.emplace_back(filePath, candidate.score, *preview,
+                                candidate.fileId);
+    }
+
+    if (hasMore) {
+      break;
+    }
+  }
+
+  if (hasMore) {
+    const auto &last = page.results.back();
+    page.next = SearchCursor{last.score, last.fileId, last.filePath};
+  }
+
+  page.totalHits = matched;
+  page.totalIsEstimate = prune || !options.fileTypeFilter.empty() ||
+                         !parsed.phrases.empty() || !parsed.ranges.empty();
+  size_t delivered = skipped + page.results.size() + (hasMore ? 1 : 0);
+  if (page.totalIsEstimate && page.totalHits < delivered) {
+    page.totalHits = delivered;
+  }
+
+  return page;
+}
+
+std::string SearchEngine::preview(const SearchResult &result,
+                                  const std::string &query,
+                                  bool prefixLastTerm) const {
+  ParsedQuery parsed = parse(query, prefixLastTerm);
+  return generatePreview(loadText(result.fileId, result.filePath),
+                         parsed.allTokens);
+}
+
+bool SearchEngine::isCancelled(const SearchOptions &options) {
+  return options.cancelled && options.cancelled();
+}
+
+bool SearchEngine::accept(int fileId, const ParsedQuery &query,
+                          const std::string &fileTypeFilter,
+                          Candidate &candidate) const {
+  candidate.paths.clear();
+  candidate.text.clear();
+
+  for (auto &[id, filePath] :
+       db_.getFilesWithSameContent(fileId, fileTypeFilter)) {
     if (filePath.empty()) {
       continue;
     }
 
-    if (!fileTypeFilter.empty()) {
-      size_t dotPos = filePath.find_last_of('.');
-      if (dotPos == std::string::npos) {
+    if (!query.directoryPrefix.empty() &&
+        filePath.compare(0, query.directoryPrefix.size(),
+                         query.directoryPrefix) != 0) {
+      continue;
+    }
+
+    candidate.paths.push_back(std::move(filePath));
+  }
+
+  if (candidate.paths.empty()) {
+    return false;
+  }
+
+  if (!query.phrases.empty()) {
+    candidate.text = loadText(fileId, candidate.paths.front());
+    std::optional<bool> streamed;
+    for (const auto &phrase : query.phrases) {
+      if (containsPhrase(candidate.text, phrase)) {
         continue;
       }
-      std::string ext = filePath.substr(dotPos + 1);
-      std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-      if (ext != fileTypeFilter) {
-        continue;
+      if (!streamed) {
+        streamed = db_.isStreamed(fileId);
+      }
+      if (!*streamed ||
+          !streamContainsPhrase(candidate.paths.front(), phrase)) {
+        return false;
+      }
+    }
+  }
+
+  candidate.fileId = fileId;
+  return true;
+}
+
+PostingsCache::Entry SearchEngine::cachedPostings(const std::string &token,
+                                                  const ParsedQuery &query,
+                                                  bool load) const {
+  if (!postingsCache_) {
+    return nullptr;
+  }
+
+  auto entry = postingsCache_->find(token);
+  if (query.stats) {
+    (entry ? query.stats->cacheHits : query.stats->cacheMisses)++;
+  }
+  if (!entry && load) {
+    auto postings = db_.searchToken(token);
+    sortByFile(postings);
+    entry = postingsCache_->insert(token, std::move(postings),
+                                   query.cacheTicket);
+  }
+  return entry;
+}
+
+std::vector<std::pair<int, int>>
+SearchEngine::postingsFor(const std::string &token,
+                          const ParsedQuery &query) const {
+  if (query.ranges.empty()) {
+    SearchSession *session = query.session;
+    if (session) {
+      auto cached = session->postings_.find(token);
+      if (cached != session->postings_.end()) {
+        return cached->second;
+      }
+    }
+
+    auto entry = cachedPostings(token, query, true);
+    auto postings = entry ? *entry : db_.searchToken(token);
+    if (!session) {
+      return postings;
+    }
+
+    if (session->cachedPostings_ + postings.size() >
+        SearchSession::MAX_CACHED_POSTINGS) {
+      session->postings_.clear();
+      session->cachedPostings_ = 0;
+    }
+    session->cachedPostings_ += postings.size();
+    session->postings_.emplace(token, postings);
+    return postings;
+  }
+
+  std::vector<std::pair<int, int>> postings;
+  auto entry = cachedPostings(token, query, false);
+  std::optional<int64_t> tokenId;
+  if (!entry && !(tokenId = db_.getTokenId(token))) {
+    return postings;
+  }
+  for (const auto &[first, last] : query.ranges) {
+    auto range = entry ? postingsBetween(*entry, first, last)
+                       : db_.readPostings(*tokenId, first, last);
+    postings.insert(postings.end(), range.begin(), range.end());
+  }
+  return postings;
+}
+
+SearchEngine::PlannedTerm
+SearchEngine::planTerm(const std::string &token) const {
+  PlannedTerm term;
+  term.token = token;
+  term.tokenId = db_.getTokenId(token);
+  if (!term.tokenId) {
+    return term;
+  }
+
+  term.blocks = db_.getScoreBlocks(*term.tokenId);
+  term.estimate = term.blocks.empty()
+                      ? PlannedTerm::UNKNOWN
+                      : (term.blocks.size() - 1) * Database::SCORE_BLOCK_SIZE +
+                            Database::SCORE_BLOCK_SIZE / 2;
+  return term;
+}
+
+// Postings of a term for the current candidates only. When the candidates
+// touch less than half of the term's score blocks, just those blocks are
+// read; otherwise one range read spans the candidates.
+SearchEngine::Postings
+SearchEngine::postingsAmong(const PlannedTerm &term, const Postings &candidates,
+                            const ParsedQuery &query,
+                            std::string &access) const {
+  Postings postings;
+  if (!term.tokenId || candidates.empty()) {
+    access = "skipped";
+    return postings;
+  }
+
+  if (query.session) {
+    postings = postingsFor(term.token, query);
+    sortByFile(postings);
+    access = "fetched";
+    return postings;
+  }
+
+  if (auto entry = cachedPostings(term.token, query, false)) {
+    postings = postingsBetween(*entry, candidates.front().first,
+                               candidates.back().first);
+    access = "cached";
+    return postings;
+  }
+
+  if (query.boundsFresh && !term.blocks.empty()) {
+    std::vector<std::pair<int, int>> reads;
+    size_t block = 0;
+    size_t lastBlock = term.blocks.size();
+    for (const auto &[fileId, score] : candidates) {
+      while (block < term.blocks.size() &&
+             term.blocks[block].lastFileId < fileId) {
+        block++;
+      }
+      if (block == term.blocks.size()) {
+        break;
+      }
+      if (block == lastBlock) {
+        reads.back().second = fileId;
+      } else {
+        reads.emplace_back(fileId, fileId);
+        lastBlock = block;
+      }
+    }
+
+    if (reads.size() * 2 < term.blocks.size()) {
+      for (const auto &[first, last] : reads) {
+        auto range = db_.readPostings(*term.tokenId, first, last);
+        postings.insert(postings.end(), range.begin(), range.end());
+      }
+      access = "probed " + std::to_string(reads.size()) + "/" +
+               std::to_string(term.blocks.size()) + " blocks";
+      return postings;
+    }
+  }
+
+  postings = db_.readPostings(*term.tokenId, candidates.front().first,
+                              candidates.back().first);
+  access = "fetched";
+  return postings;
+}
+
+// Plans conjunctions from the rarest term: it alone is fetched in full,
+// the type filter is applied to it, and every further AND, NOT and OR term
+// is read only where candidates remain. A conjunction that becomes empty
+// ends evaluation without touching the remaining terms.
+std::vector<SearchEngine::Candidate>
+SearchEngine::scoreExhaustive(const ParsedQuery &query,
+                              const SearchOptions &options,
+                              size_t &matched) const {
+  std::vector<std::string> plan;
+  size_t postingsRead = 0;
+  size_t scored = 0;
+  auto report = [&] {
+    if (options.stats) {
+      options.stats->plan = plan;
+      options.stats->postingsRead = postingsRead;
+      options.stats->documentsScored = scored;
+    }
+  };
+  auto describe = [](const PlannedTerm &term) {
+    return "\"" + term.token + "\" (~" +
+           (term.estimate == PlannedTerm::UNKNOWN
+                ? std::string("?")
+                : std::to_string(term.estimate)) +
+           " docs)";
+  };
+
+  std::vector<PlannedTerm> andTerms;
+  for (const auto &token : query.andTokens) {
+    andTerms.push_back(planTerm(token));
+  }
+  std::stable_sort(andTerms.begin(), andTerms.end(),
+                   [](const PlannedTerm &a, const PlannedTerm &b) {
+                     return a.estimate < b.estimate;
+                   });
+
+  std::optional<std::vector<int>> typeFiles;
+  if (!options.fileTypeFilter.empty()) {
+    typeFiles = db_.getDocumentsWithExtension(options.fileTypeFilter);
+    if (typeFiles->empty()) {
+      plan.push_back("type ." + options.fileTypeFilter + ": no documents");
+      report();
+      return {};
+    }
+  }
+  auto skipByType = [&](ScoredFiles &scores) {
+    if (typeFiles) {
+      keepFiles(scores, *typeFiles);
+      plan.push_back("type ." + options.fileTypeFilter + ": " +
+                     std::to_string(typeFiles->size()) + " documents, " +
+                     std::to_string(scores.size()) + " candidates");
+    }
+  };
+
+  ScoredFiles scores;
+  if (!andTerms.empty()) {
+    if (!andTerms.front().tokenId) {
+      plan.push_back("and \"" + andTerms.front().token +
+                     "\": not indexed, conjunction empty");
+      report();
+      return {};
+    }
+
+    scores = postingsFor(andTerms.front().token, query);
+    sortByFile(scores);
+    postingsRead += scores.size();
+    scored = scores.size();
+    plan.push_back("and " + describe(andTerms.front()) + ": drive, " +
+                   std::to_string(scores.size()) + " candidates");
+    skipByType(scores);
+
+    for (size_t i = 1; i < andTerms.size() && !scores.empty(); ++i) {
+      if (isCancelled(options)) {
+        return {};
+      }
+      std::string access;
+      auto postings = postingsAmong(andTerms[i], scores, query, access);
+      postingsRead += postings.size();
+      intersectScores(scores, postings);
+      plan.push_back("and " + describe(andTerms[i]) + ": " + access + ", " +
+                     std::to_string(scores.size()) + " candidates");
+    }
+  } else {
+    for (const auto &token : query.orTokens) {
+      if (isCancelled(options)) {
+        return {};
+      }
+      auto postings = postingsFor(token, query);
+      sortByFile(postings);
+      postingsRead += postings.size();
+      uniteScores(scores, postings);
+    }
+    scored = scores.size();
+    plan.push_back("or " + std::to_string(query.orTokens.size()) +
+                   " term(s): fetched, " + std::to_string(scores.size()) +
+                   " candidates");
+    skipByType(scores);
+  }
+
+  for (const auto &token : query.notTokens) {
+    if (scores.empty()) {
+      break;
+    }
+    PlannedTerm term = planTerm(token);
+    std::string access;
+    auto postings = postingsAmong(term, scores, query, access);
+    postingsRead += postings.size();
+    removeFiles(scores, postings);
+    plan.push_back("not " + describe(term) + ": " + access + ", " +
+                   std::to_string(scores.size()) + " candidates");
+  }
+
+  if (!andTerms.empty() && !query.orTokens.empty() && !scores.empty()) {
+    size_t probed = 0;
+    for (const auto &token : query.orTokens) {
+      if (isCancelled(options)) {
+        return {};
+      }
+      std::string access;
+      auto postings = postingsAmong(planTerm(token), scores, query, access);
+      postingsRead += postings.size();
+      addScores(scores, postings);
+      probed += access.compare(0, 6, "probed") == 0 ? 1 : 0;
+    }
+    plan.push_back("or " + std::to_string(query.orTokens.size()) +
+                   " term(s): score only, " + std::to_string(probed) +
+                   " probed");
+  }
+
+  std::vector<Candidate> candidates;
+  std::vector<int> matchedFiles;
+  matchedFiles.reserve(scores.size());
+
+  for (const auto &[fileId, score] : scores) {
+    if (isCancelled(options)) {
+      return {};
+    }
+
+    matchedFiles.push_back(fileId);
+    if (options.after && ranksBefore(score, fileId, options.after->score,
+                                     options.after->fileId)) {
+      continue;
+    }
+
+    Candidate candidate;
+    candidate.fileId = fileId;
+    candidate.score = score;
+    candidates.push_back(std::move(candidate));
+  }
+
+  // Pages list every path that shares a matched file's content.
+  matched = db_.countPathsWithContent(matchedFiles, query.directoryPrefix);
+  report();
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return ranksBefore(a.score, a.fileId, b.score, b.fileId);
+            });
+
+  return candidates;
+}
+
+std::vector<SearchEngine::Candidate>
+SearchEngine::scoreTopK(const ParsedQuery &query,
+                        const SearchOptions &options, size_t depth,
+                        size_t &matched) const {
+  std::set<int> notFileSet;
+  for (const auto &token : query.notTokens) {
+    for (const auto &[fileId, frequency] : postingsFor(token, query)) {
+      notFileSet.insert(fileId);
+    }
+  }
+
+  std::vector<std::unique_ptr<PostingCursor>> cursors;
+  for (const auto &token : query.orTokens) {
+    if (auto tokenId = db_.getTokenId(token)) {
+      auto cached = cachedPostings(
+          token, query, postingsCache_ && postingsCache_->wanted(token));
+      cursors.push_back(std::make_unique<PostingCursor>(
+          db_, *tokenId, db_.getScoreBlocks(*tokenId), std::move(cached)));
+      matched = std::max(matched, cursors.back()->estimatedCount());
+    }
+  }
+
+  auto order = [](const Candidate &a, const Candidate &b) {
+    return ranksBefore(a.score, a.fileId, b.score, b.fileId);
+  };
+  std::vector<Candidate> heap;
+
+  size_t scored = 0;
+  size_t blocksSkipped = 0;
+
+  std::vector<PostingCursor *> active;
+  for (const auto &cursor : cursors) {
+    active.push_back(cursor.get());
+  }
+
+  while (true) {
+    if ((scored & 63) == 0 && isCancelled(options)) {
+      return {};
+    }
+
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [](const PostingCursor *cursor) {
+                                  return cursor->doc() == PostingCursor::END;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      break;
+    }
+    std::sort(active.begin(), active.end(),
+              [](const PostingCursor *a, const PostingCursor *b) {
+                return a->doc() < b->doc();
+              });
+
+    bool full = heap.size() >= depth;
+    int threshold = full ? heap.front().score : 0;
+
+    size_t pivot = 0;
+    int upperBound = 0;
+    for (; pivot < active.size(); ++pivot) {
+      upperBound += active[pivot]->maxScore();
+      if (upperBound >= threshold) {
+        break;
       }
     }
+    if (pivot == active.size()) {
+      break;
+    }
+
+    int pivotDoc = active[pivot]->doc();
+    while (pivot + 1 < active.size() && active[pivot + 1]->doc() == pivotDoc) {
+      pivot++;
+    }
 
-    bool phraseMatch = true;
-    if (!phrases.empty()) {
-      std::string text = TextExtractor::extractText(filePath);
-      for (const auto &phrase : phrases) {
-        if (!containsPhrase(text, phrase)) {
-          phraseMatch = false;
-          break;
+    if (full) {
+      int blockBound = 0;
+      int nextDoc = pivot + 1 < active.size() ? active[pivot + 1]->doc()
+                                              : PostingCursor::END;
+      for (size_t i = 0; i <= pivot; ++i) {
+        const ScoreBlock *block = active[i]->blockFor(pivotDoc);
+        if (block) {
+          blockBound += block->maxFrequency;
+          if (block->lastFileId < PostingCursor::END) {
+            nextDoc = std::min(nextDoc, block->lastFileId + 1);
+          }
         }
       }
+      if (blockBound < threshold) {
+        blocksSkipped++;
+        for (size_t i = 0; i <= pivot; ++i) {
+          active[i]->advance(nextDoc);
+        }
+        continue;
+      }
     }
 
-    if (!phraseMatch) {
+    if (active[0]->doc() != pivotDoc) {
+      for (size_t i = 0; i <= pivot && active[i]->doc() < pivotDoc; ++i) {
+        active[i]->advance(pivotDoc);
+      }
       continue;
     }
 
-    std::string text = TextExtractor::extractText(filePath);
-    std::string preview = generatePreview(text, allQueryTokens);
+    int score = 0;
+    for (size_t i = 0; i <= pivot; ++i) {
+      score += active[i]->frequency();
+      active[i]->next();
+    }
+    scored++;
+
+    if (full && !ranksBefore(score, pivotDoc, heap.front().score,
+                             heap.front().fileId)) {
+      continue;
+    }
+    if (notFileSet.count(pivotDoc) > 0) {
+      continue;
+    }
+    if (options.after && ranksBefore(score, pivotDoc, options.after->score,
+                                     options.after->fileId)) {
+      continue;
+    }
 
-    searchResults.emplace_back(filePath, score, preview);
+    Candidate candidate;
+    if (!accept(pivotDoc, query, options.fileTypeFilter, candidate)) {
+      continue;
+    }
+    candidate.score = score;
+    candidate.accepted = true;
+    heap.push_back(std::move(candidate));
+    std::push_heap(heap.begin(), heap.end(), order);
+    if (heap.size() > depth) {
+      std::pop_heap(heap.begin(), heap.end(), order);
+      heap.pop_back();
+    }
   }
 
-  std::sort(searchResults.begin(), searchResults.end(),
-            [](const SearchResult &a, const SearchResult &b) {
-              return a.score > b.score;
-            });
+  if (options.stats) {
+    options.stats->documentsScored = scored;
+    options.stats->blocksSkipped = blocksSkipped;
+    options.stats->plan = {"or " + std::to_string(query.orTokens.size()) +
+                           " term(s): top " + std::to_string(depth) +
+                           " with block-max pruning"};
+  }
 
-  return searchResults;
+  std::sort_heap(heap.begin(), heap.end(), order);
+  return heap;
 }
 
 } // namespace glint
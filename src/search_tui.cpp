@@ -0,0 +1,278 @@
+#include "glint/search_tui.h"
+#include <algorithm>
+#include <curses.h>
+
+namespace glint {
+
+namespace {
+
+constexpr int KEY_CTRL_C = 3;
+constexpr int KEY_ESCAPE = 27;
+constexpr int KEY_DEL = 127;
+
+// Puts the terminal into curses mode for its lifetime, so the terminal is
+// restored however run() is left.
+class Screen {
+public:
+  Screen() {
+    initscr();
+    raw();
+    noecho();
+    keypad(stdscr, TRUE);
+    timeout(20);
+  }
+  ~Screen() { endwin(); }
+
+  Screen(const Screen &) = delete;
+  Screen &operator=(const Screen &) = delete;
+};
+
+} // namespace
+
+SearchTui::SearchTui(const SearchEngine &engine, const TuiOptions &options)
+    : engine_(engine), options_(options) {
+  worker_ = std::thread([this] { evaluate(); });
+}
+
+SearchTui::~SearchTui() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  worker_.join();
+}
+
+void SearchTui::submit(const std::string &query) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = query;
+    submittedAt_ = std::chrono::steady_clock::now();
+    requested_++;
+  }
+  wake_.notify_all();
+}
+
+void SearchTui::evaluate() {
+  uint64_t served = 0;
+
+  while (true) {
+    std::string query;
+    uint64_t generation = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stopping_ || requested_ != served; });
+      if (stopping_) {
+        return;
+      }
+
+      generation = requested_;
+      wake_.wait_for(lock, options_.debounce,
+                     [&] { return stopping_ || requested_ != generation; });
+      if (stopping_) {
+        return;
+      }
+      if (requested_ != generation) {
+        continue;
+      }
+
+      query = pending_;
+      served = generation;
+    }
+
+    auto stale = [&] { return requested_ != generation; };
+
+    SearchStats stats;
+    SearchOptions options;
+    options.limit = options_.maxResults;
+    options.previews = false;
+    options.prefixLastTerm = true;
+    options.session = &session_;
+    options.cancelled = stale;
+    options.stats = &stats;
+
+    // An escaping exception would terminate the program with the terminal
+    // still in curses mode; the failure is shown as the query's status.
+    try {
+      auto start = std::chrono::steady_clock::now();
+      auto results = engine_.search(query, options);
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start);
+      if (stale()) {
+        continue;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_ = results;
+        previews_.assign(results.size(), "");
+        stats_ = stats;
+        elapsed_ = elapsed;
+        error_.clear();
+        shown_ = generation;
+        dirty_ = true;
+      }
+
+      for (size_t i = 0; i < results.size() && !stale(); ++i) {
+        std::string preview = engine_.preview(results[i], query, true);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shown_ == generation && i < previews_.size()) {
+          previews_[i] = std::move(preview);
+          dirty_ = true;
+        }
+      }
+    } catch (const std::exception &e) {
+      showError(generation, e.what());
+    } catch (...) {
+      showError(generation, "unknown error");
+    }
+  }
+}
+
+void SearchTui::showError(uint64_t generation, const std::string &message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (requested_ != generation) {
+    return;
+  }
+  results_.clear();
+  previews_.clear();
+  error_ = message;
+  shown_ = generation;
+  dirty_ = true;
+}
+
+void SearchTui::render(const std::string &query, size_t selected,
+                       size_t &scroll) {
+  int height = 0;
+  int width = 0;
+  getmaxyx(stdscr, height, width);
+  size_t rows = height > 3 ? static_cast<size_t>(height - 3) / 2 : 1;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  erase();
+
+  std::string status;
+  if (query.empty()) {
+    status = "Type to search, Enter to select, Esc to quit";
+  } else if (shown_ != requested_) {
+    auto waiting = std::chrono::steady_clock::now() - submittedAt_;
+    if (waiting > options_.latencyBudget) {
+      status = "Searching...";
+    }
+  }
+  if (status.empty() && !error_.empty()) {
+    status = "Error: " + error_;
+  } else if (status.empty() && !query.empty()) {
+    status = std::to_string(results_.size()) +
+             (results_.size() >= options_.maxResults ? "+" : "") +
+             " result(s) in " + std::to_string(elapsed_.count()) + " ms";
+    if (stats_.refined) {
+      status += " (refined)";
+    }
+  }
+
+  attron(A_DIM);
+  mvaddnstr(1, 0, status.c_str(), width);
+  attroff(A_DIM);
+
+  if (selected < scroll) {
+    scroll = selected;
+  } else if (selected >= scroll + rows) {
+    scroll = selected - rows + 1;
+  }
+
+  int line = 2;
+  for (size_t i = scroll; i < results_.size() && i < scroll + rows; ++i) {
+    std::string title = results_[i].filePath + " (" +
+                        std::to_string(results_[i].score) + ")";
+    if (i == selected) {
+      attron(A_REVERSE);
+    }
+    mvaddnstr(line++, 0, title.c_str(), width);
+    if (i == selected) {
+      attroff(A_REVERSE);
+    }
+
+    std::string preview = previews_[i];
+    std::replace(preview.begin(), preview.end(), '\n', ' ');
+    std::replace(preview.begin(), preview.end(), '\t', ' ');
+    attron(A_DIM);
+    mvaddnstr(line++, 2, preview.c_str(), std::max(width - 2, 0));
+    attroff(A_DIM);
+  }
+
+  std::string prompt = "> " + query;
+  mvaddnstr(0, 0, prompt.c_str(), width);
+  move(0, std::min(static_cast<int>(prompt.size()), std::max(width - 1, 0)));
+
+  dirty_ = false;
+  refresh();
+}
+
+std::string SearchTui::run() {
+  Screen screen;
+
+  std::string query;
+  std::string chosen;
+  size_t selected = 0;
+  size_t scroll = 0;
+  bool redraw = true;
+
+  while (true) {
+    bool waiting;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      redraw = redraw || dirty_;
+      waiting = shown_ != requested_;
+    }
+    if (redraw || waiting) {
+      render(query, selected, scroll);
+      redraw = false;
+    }
+
+    int key = getch();
+    if (key == ERR) {
+      continue;
+    }
+
+    if (key == KEY_ESCAPE || key == KEY_CTRL_C) {
+      break;
+    }
+
+    size_t count;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      count = results_.size();
+    }
+
+    if (key == '\n' || key == '\r' || key == KEY_ENTER) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (selected < results_.size()) {
+        chosen = results_[selected].filePath;
+      }
+      break;
+    }
+    if (key == KEY_UP) {
+      selected = selected > 0 ? selected - 1 : 0;
+    } else if (key == KEY_DOWN) {
+      selected = selected + 1 < count ? selected + 1 : selected;
+    } else if (key == KEY_BACKSPACE || key == KEY_DEL || key == '\b') {
+      if (!query.empty()) {
+        query.pop_back();
+        selected = 0;
+        scroll = 0;
+        submit(query);
+      }
+    } else if (key >= 32 && key < 127) {
+      query += static_cast<char>(key);
+      selected = 0;
+      scroll = 0;
+      submit(query);
+    }
+    redraw = true;
+  }
+
+  return chosen;
+}
+
+} // namespace glint
@@ -1,23 +1,17 @@
 #include "glint/text_extractor.h"
+#include "glint/content_sniffer.h"
+#include <algorithm>
 #include <fstream>
-#include <set>
-#include <sstream>
 
 
 namespace glint {
 
-bool TextExtractor::isTextFile(const std::filesystem::path &filePath) {
-  static const std::set<std::string> textExtensions = {
-      ".txt", ".md",   ".cpp", ".h",     ".hpp",  ".c",    ".cc",
-      ".cxx", ".py",   ".js",  ".ts",    ".java", ".cs",   ".go",
-      ".rs",  ".html", ".css", ".xml",   ".json", ".yaml", ".yml",
-      ".sh",  ".bat",  ".ps1", ".cmake", ".ini",  ".cfg"};
-
-  std::string ext = filePath.extension().string();
-  return textExtensions.find(ext) != textExtensions.end();
+std::string TextExtractor::extractText(const std::filesystem::path &filePath) {
+  return extractText(filePath, ExtractionPolicy{});
 }
 
-std::string TextExtractor::extractText(const std::filesystem::path &filePath) {
+std::string TextExtractor::extractText(const std::filesystem::path &filePath,
+                                       const ExtractionPolicy &policy) {
   if (!std::filesystem::exists(filePath)) {
     return "";
   }
@@ -27,11 +21,11 @@ std::string TextExtractor::extractText(const std::filesystem::path &filePath) {
   }
 
   auto fileSize = std::filesystem::file_size(filePath);
-  if (fileSize > MAX_FILE_SIZE || fileSize == 0) {
+  if (fileSize == 0) {
     return "";
   }
-
-  if (!isTextFile(filePath)) {
+  if (fileSize > policy.maxFileSize &&
+      policy.oversize != OversizePolicy::Truncate) {
     return "";
   }
 
@@ -40,9 +34,87 @@ std::string TextExtractor::extractText(const std::filesystem::path &filePath) {
     return "";
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  return buffer.str();
+  auto length = static_cast<size_t>(
+      std::min<std::uintmax_t>(fileSize, policy.maxFileSize));
+  std::string text(length, '\0');
+
+  size_t head = std::min(length, ContentSniffer::SNIFF_SIZE);
+  file.read(text.data(), static_cast<std::streamsize>(head));
+  size_t got = static_cast<size_t>(file.gcount());
+  if (policy.sniffContent &&
+      ContentSniffer::classify(std::string_view(text.data(), got),
+                               got == fileSize) != ContentType::Text) {
+    return "";
+  }
+
+  if (got == head && length > head) {
+    file.read(text.data() + head, static_cast<std::streamsize>(length - head));
+    got += static_cast<size_t>(file.gcount());
+  }
+  text.resize(got);
+  return text;
+}
+
+bool TextExtractor::extractChunks(const std::filesystem::path &filePath,
+                                  const ExtractionPolicy &policy,
+                                  const ChunkCallback &callback) {
+  if (!std::filesystem::exists(filePath)) {
+    return false;
+  }
+
+  if (!std::filesystem::is_regular_file(filePath)) {
+    return false;
+  }
+
+  auto fileSize = std::filesystem::file_size(filePath);
+  if (fileSize == 0) {
+    return false;
+  }
+  if (fileSize > policy.maxFileSize &&
+      policy.oversize == OversizePolicy::Skip) {
+    return false;
+  }
+
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::uintmax_t remaining = fileSize;
+  if (fileSize > policy.maxFileSize &&
+      policy.oversize == OversizePolicy::Truncate) {
+    remaining = policy.maxFileSize;
+  }
+
+  std::string chunk(
+      std::max<size_t>(policy.chunkSize, ContentSniffer::SNIFF_SIZE), '\0');
+  bool first = true;
+  while (remaining > 0 && file) {
+    auto toRead = static_cast<std::streamsize>(
+        std::min<std::uintmax_t>(chunk.size(), remaining));
+    file.read(chunk.data(), toRead);
+    auto got = file.gcount();
+    if (got <= 0) {
+      break;
+    }
+
+    if (first && policy.sniffContent) {
+      size_t head =
+          std::min(static_cast<size_t>(got), ContentSniffer::SNIFF_SIZE);
+      if (ContentSniffer::classify(std::string_view(chunk.data(), head),
+                                   head == fileSize) != ContentType::Text) {
+        return false;
+      }
+    }
+    first = false;
+
+    remaining -= static_cast<std::uintmax_t>(got);
+    if (!callback(std::string_view(chunk.data(), static_cast<size_t>(got)))) {
+      break;
+    }
+  }
+
+  return true;
 }
 
 } // namespace glint
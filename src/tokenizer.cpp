@@ -1,49 +1,300 @@
 #include "glint/tokenizer.h"
-#include <cctype>
-#include <sstream>
+#include <algorithm>
+#include <array>
+#include <utility>
 
 namespace glint {
 
-std::string Tokenizer::normalize(const std::string &word) {
+namespace {
+
+constexpr size_t MIN_TOKEN_LENGTH = Tokenizer<>::MIN_WORD_LENGTH;
+constexpr size_t MIN_HEX_ID_LENGTH = 8;
+
+enum CharClass : unsigned char {
+  SPACE = 1,
+  LOWER = 2,
+  UPPER = 4,
+  DIGIT = 8,
+  HEX = 16,
+};
+
+constexpr std::array<unsigned char, 256> makeCharClasses() {
+  std::array<unsigned char, 256> classes{};
+  for (unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+    classes[c] = SPACE;
+  }
+  for (int c = 'a'; c <= 'z'; ++c) {
+    classes[c] = LOWER | (c <= 'f' ? HEX : 0);
+  }
+  for (int c = 'A'; c <= 'Z'; ++c) {
+    classes[c] = UPPER | (c <= 'F' ? HEX : 0);
+  }
+  for (int c = '0'; c <= '9'; ++c) {
+    classes[c] = DIGIT | HEX;
+  }
+  return classes;
+}
+
+constexpr auto CHAR_CLASSES = makeCharClasses();
+
+bool is(char c, unsigned char mask) {
+  return (CHAR_CLASSES[static_cast<unsigned char>(c)] & mask) != 0;
+}
+
+char lower(char c) { return is(c, UPPER) ? static_cast<char>(c + 32) : c; }
+
+bool isValidToken(std::string_view token) {
+  return token.size() >= MIN_TOKEN_LENGTH &&
+         std::any_of(token.begin(), token.end(),
+                     [](char c) { return is(c, LOWER | UPPER); });
+}
+
+template <typename Sink> void emitIfValid(std::string &&token, Sink &sink) {
+  if (isValidToken(token)) {
+    sink(std::move(token));
+  }
+}
+
+// The word with every non-alphanumeric byte dropped. Queries are normalized
+// this way, so prose and code keep emitting it for whole words.
+std::string compound(std::string_view word) {
   std::string normalized;
   normalized.reserve(word.size());
-
   for (char c : word) {
-    if (std::isalnum(static_cast<unsigned char>(c))) {
-      normalized += std::tolower(static_cast<unsigned char>(c));
+    if (is(c, LOWER | UPPER | DIGIT)) {
+      normalized += lower(c);
     }
   }
-
   return normalized;
 }
 
-bool Tokenizer::isValidToken(const std::string &token) {
-  if (token.length() < MIN_WORD_LENGTH) {
-    return false;
+} // namespace
+
+struct ProsePolicy {
+  template <typename Sink>
+  static void split(std::string_view word, Sink &sink) {
+    emitIfValid(compound(word), sink);
   }
+};
 
-  for (char c : token) {
-    if (std::isalpha(static_cast<unsigned char>(c))) {
-      return true;
+// Splits identifiers at punctuation, underscores and camelCase humps
+// ("HTTPServer" -> http, server). Each identifier with more than one part
+// is also emitted whole, as is a word spanning several identifiers.
+struct CodePolicy {
+  template <typename Sink>
+  static void split(std::string_view word, Sink &sink) {
+    size_t identifiers = 0;
+    size_t pos = 0;
+    while (pos < word.size()) {
+      while (pos < word.size() && !is(word[pos], LOWER | UPPER | DIGIT)) {
+        pos++;
+      }
+      size_t start = pos;
+      while (pos < word.size() &&
+             (word[pos] == '_' || is(word[pos], LOWER | UPPER | DIGIT))) {
+        pos++;
+      }
+      if (start < pos) {
+        identifiers++;
+        splitIdentifier(word.substr(start, pos - start), sink);
+      }
+    }
+
+    if (identifiers > 1) {
+      emitIfValid(compound(word), sink);
     }
   }
 
-  return false;
-}
+  template <typename Sink>
+  static void splitIdentifier(std::string_view identifier, Sink &sink) {
+    size_t parts = 0;
+    size_t start = 0;
+    auto endPart = [&](size_t end) {
+      if (start < end) {
+        parts++;
+        emitIfValid(compound(identifier.substr(start, end - start)), sink);
+      }
+    };
+
+    for (size_t i = 0; i < identifier.size(); ++i) {
+      char c = identifier[i];
+      if (c == '_') {
+        endPart(i);
+        start = i + 1;
+      } else if (i > start && is(c, UPPER) &&
+                 (is(identifier[i - 1], LOWER | DIGIT) ||
+                  (i + 1 < identifier.size() &&
+                   is(identifier[i - 1], UPPER) &&
+                   is(identifier[i + 1], LOWER)))) {
+        endPart(i);
+        start = i;
+      }
+    }
+    endPart(identifier.size());
+
+    if (parts > 1) {
+      emitIfValid(compound(identifier), sink);
+    }
+  }
+};
 
-std::vector<std::string> Tokenizer::tokenize(const std::string &text) {
+// Splits at every non-alphanumeric byte so "user=alice" or "[ERROR]" yield
+// their words, and drops runs that start with a digit (timestamps, sizes)
+// or look like hex ids and hashes. Like CodePolicy it also emits the whole
+// of each multi-part identifier and word, which is what queries look up.
+struct LogPolicy {
+  template <typename Sink>
+  static void split(std::string_view word, Sink &sink) {
+    size_t identifiers = 0;
+    size_t pos = 0;
+    while (pos < word.size()) {
+      while (pos < word.size() && !is(word[pos], LOWER | UPPER | DIGIT)) {
+        pos++;
+      }
+      size_t start = pos;
+      while (pos < word.size() &&
+             (word[pos] == '_' || is(word[pos], LOWER | UPPER | DIGIT))) {
+        pos++;
+      }
+      if (start < pos) {
+        identifiers++;
+        splitIdentifier(word.substr(start, pos - start), sink);
+      }
+    }
+
+    if (identifiers > 1) {
+      emitIfKept(compound(word), sink);
+    }
+  }
+
+  template <typename Sink>
+  static void splitIdentifier(std::string_view identifier, Sink &sink) {
+    size_t parts = 0;
+    size_t pos = 0;
+    while (pos < identifier.size()) {
+      while (pos < identifier.size() && identifier[pos] == '_') {
+        pos++;
+      }
+      size_t start = pos;
+      while (pos < identifier.size() && identifier[pos] != '_') {
+        pos++;
+      }
+      if (start < pos) {
+        parts++;
+        emitIfKept(compound(identifier.substr(start, pos - start)), sink);
+      }
+    }
+
+    if (parts > 1) {
+      emitIfKept(compound(identifier), sink);
+    }
+  }
+
+  template <typename Sink>
+  static void emitIfKept(std::string &&token, Sink &sink) {
+    bool hex = std::all_of(token.begin(), token.end(),
+                           [](char c) { return is(c, HEX); });
+    bool digit = std::any_of(token.begin(), token.end(),
+                             [](char c) { return is(c, DIGIT); });
+    if (token.empty() || is(token.front(), DIGIT) ||
+        (token.size() >= MIN_HEX_ID_LENGTH && hex && digit)) {
+      return;
+    }
+    emitIfValid(std::move(token), sink);
+  }
+};
+
+template <typename Policy>
+std::vector<std::string> Tokenizer<Policy>::tokenize(std::string_view text) {
   std::vector<std::string> tokens;
-  std::istringstream stream(text);
-  std::string word;
+  auto sink = [&](std::string &&token) { tokens.push_back(std::move(token)); };
 
-  while (stream >> word) {
-    std::string normalized = normalize(word);
-    if (isValidToken(normalized)) {
-      tokens.push_back(normalized);
+  size_t pos = 0;
+  while (pos < text.size()) {
+    while (pos < text.size() && is(text[pos], SPACE)) {
+      pos++;
+    }
+    size_t start = pos;
+    while (pos < text.size() && !is(text[pos], SPACE)) {
+      pos++;
+    }
+    if (start < pos) {
+      Policy::split(text.substr(start, pos - start), sink);
     }
   }
 
   return tokens;
 }
 
+template <typename Policy>
+Tokenizer<Policy>::Stream::Stream(TokenSink sink) : sink_(std::move(sink)) {}
+
+template <typename Policy>
+void Tokenizer<Policy>::Stream::emit(std::string_view word) {
+  Policy::split(word, sink_);
+}
+
+template <typename Policy>
+void Tokenizer<Policy>::Stream::feed(std::string_view chunk) {
+  size_t pos = 0;
+  while (pos < chunk.size()) {
+    if (is(chunk[pos], SPACE)) {
+      if (!carry_.empty()) {
+        emit(carry_);
+        carry_.clear();
+      }
+      pos++;
+      continue;
+    }
+
+    size_t end = pos;
+    while (end < chunk.size() && !is(chunk[end], SPACE)) {
+      end++;
+    }
+
+    if (carry_.empty() && end < chunk.size()) {
+      emit(chunk.substr(pos, end - pos));
+    } else {
+      carry_.append(chunk.data() + pos, end - pos);
+      if (carry_.size() >= MAX_CARRY_LENGTH) {
+        emit(carry_);
+        carry_.clear();
+      }
+    }
+    pos = end;
+  }
+}
+
+template <typename Policy> void Tokenizer<Policy>::Stream::finish() {
+  if (!carry_.empty()) {
+    emit(carry_);
+    carry_.clear();
+  }
+}
+
+template class Tokenizer<ProsePolicy>;
+template class Tokenizer<CodePolicy>;
+template class Tokenizer<LogPolicy>;
+
+TextKind textKindFor(const std::filesystem::path &path) {
+  static const std::vector<std::string> codeExtensions = {
+      ".c", ".cc", ".cpp", ".cxx", ".h", ".hh", ".hpp", ".hxx",
+      ".inl", ".ipp", ".java", ".kt", ".scala", ".cs", ".go", ".rs",
+      ".swift", ".m", ".mm", ".js", ".jsx", ".ts", ".tsx", ".py",
+      ".rb", ".php", ".pl", ".lua", ".sh", ".bash", ".cmake", ".sql"};
+
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return lower(c); });
+
+  if (extension == ".log") {
+    return TextKind::Log;
+  }
+  if (std::find(codeExtensions.begin(), codeExtensions.end(), extension) !=
+      codeExtensions.end()) {
+    return TextKind::Code;
+  }
+  return TextKind::Prose;
+}
+
 } // namespace glint
@@ -0,0 +1,646 @@
+#include "glint/trigram.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <optional>
+#include <set>
+
+namespace glint {
+
+namespace {
+
+// Exact string sets larger than this collapse into prefix/suffix facts, and
+// prefix or suffix sets larger than MAX_SET are forgotten.
+constexpr size_t MAX_EXACT = 16;
+constexpr size_t MAX_SET = 64;
+constexpr size_t MAX_CLASS = 8;
+
+using StringSet = std::set<std::string>;
+
+char fold(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool isSingle(const TrigramQuery &query) {
+  return query.op == TrigramQuery::Op::And && query.trigrams.size() == 1 &&
+         query.subs.empty();
+}
+
+bool same(const TrigramQuery &a, const TrigramQuery &b) {
+  if (a.op != b.op || a.trigrams != b.trigrams ||
+      a.subs.size() != b.subs.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.subs.size(); ++i) {
+    if (!same(a.subs[i], b.subs[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void addSub(std::vector<TrigramQuery> &subs, TrigramQuery &&sub) {
+  for (const auto &existing : subs) {
+    if (same(existing, sub)) {
+      return;
+    }
+  }
+  subs.push_back(std::move(sub));
+}
+
+void mergeTrigrams(std::vector<uint32_t> &into,
+                   const std::vector<uint32_t> &from) {
+  into.insert(into.end(), from.begin(), from.end());
+  std::sort(into.begin(), into.end());
+  into.erase(std::unique(into.begin(), into.end()), into.end());
+}
+
+TrigramQuery literal(const std::string &text) {
+  TrigramQuery query;
+  query.trigrams = extractTrigrams(text);
+  if (!query.trigrams.empty()) {
+    query.op = TrigramQuery::Op::And;
+  }
+  return query;
+}
+
+TrigramQuery anyString(const StringSet &strings) {
+  TrigramQuery query = TrigramQuery::none();
+  for (const auto &text : strings) {
+    query = anyOf(std::move(query), literal(text));
+  }
+  return query;
+}
+
+StringSet unite(StringSet a, const StringSet &b) {
+  a.insert(b.begin(), b.end());
+  return a;
+}
+
+// Every concatenation of a string from a with one from b. Products too big
+// to be useful become {""}, which says nothing about the match.
+StringSet cross(const StringSet &a, const StringSet &b) {
+  if (a.size() * b.size() > MAX_SET * 4) {
+    return {""};
+  }
+  StringSet product;
+  for (const auto &left : a) {
+    for (const auto &right : b) {
+      product.insert(left + right);
+    }
+  }
+  return product;
+}
+
+// What a regex fragment can match: an exact set of strings when small,
+// otherwise the possible first and last two bytes plus a trigram query
+// every match must satisfy. Strings are ASCII-folded like the index.
+struct Info {
+  bool emptyable = false;
+  std::optional<StringSet> exact;
+  StringSet prefix{""};
+  StringSet suffix{""};
+  TrigramQuery match;
+};
+
+Info emptyString() {
+  Info info;
+  info.emptyable = true;
+  info.exact = StringSet{""};
+  return info;
+}
+
+Info anyChar() { return Info{}; }
+
+Info anything() {
+  Info info;
+  info.emptyable = true;
+  return info;
+}
+
+Info chars(StringSet set) {
+  Info info;
+  info.exact = std::move(set);
+  return info;
+}
+
+void simplify(Info &info) {
+  if (info.exact && info.exact->size() > MAX_EXACT) {
+    info.match = allOf(std::move(info.match), anyString(*info.exact));
+    info.prefix = std::move(*info.exact);
+    info.suffix = info.prefix;
+    info.exact.reset();
+  }
+  if (info.exact) {
+    return;
+  }
+
+  info.match = allOf(std::move(info.match), anyString(info.prefix));
+  info.match = allOf(std::move(info.match), anyString(info.suffix));
+
+  StringSet prefix;
+  StringSet suffix;
+  for (const auto &text : info.prefix) {
+    prefix.insert(text.substr(0, 2));
+  }
+  for (const auto &text : info.suffix) {
+    suffix.insert(text.size() > 2 ? text.substr(text.size() - 2) : text);
+  }
+  info.prefix = prefix.size() > MAX_SET ? StringSet{""} : std::move(prefix);
+  info.suffix = suffix.size() > MAX_SET ? StringSet{""} : std::move(suffix);
+}
+
+void makeInexact(Info &info) {
+  if (!info.exact) {
+    return;
+  }
+  info.match = allOf(std::move(info.match), anyString(*info.exact));
+  info.prefix = *info.exact;
+  info.suffix = std::move(*info.exact);
+  info.exact.reset();
+  simplify(info);
+}
+
+Info concat(Info x, Info y) {
+  Info info;
+  info.emptyable = x.emptyable && y.emptyable;
+  info.match = allOf(std::move(x.match), std::move(y.match));
+
+  if (x.exact && y.exact && x.exact->size() * y.exact->size() <= MAX_EXACT) {
+    info.exact = cross(*x.exact, *y.exact);
+    return info;
+  }
+
+  const StringSet &ending = x.exact ? *x.exact : x.suffix;
+  const StringSet &beginning = y.exact ? *y.exact : y.prefix;
+
+  if (x.exact) {
+    info.prefix = cross(*x.exact, beginning);
+  } else {
+    info.prefix = x.emptyable ? unite(x.prefix, beginning) : x.prefix;
+  }
+  if (y.exact) {
+    info.suffix = cross(ending, *y.exact);
+  } else {
+    info.suffix = y.emptyable ? unite(y.suffix, ending) : y.suffix;
+  }
+  info.match =
+      allOf(std::move(info.match), anyString(cross(ending, beginning)));
+
+  simplify(info);
+  return info;
+}
+
+Info alternate(Info x, Info y) {
+  Info info;
+  info.emptyable = x.emptyable || y.emptyable;
+
+  if (x.exact && y.exact && x.exact->size() + y.exact->size() <= MAX_EXACT) {
+    info.exact = unite(*x.exact, *y.exact);
+    info.match = anyOf(std::move(x.match), std::move(y.match));
+    return info;
+  }
+
+  makeInexact(x);
+  makeInexact(y);
+  info.prefix = unite(x.prefix, y.prefix);
+  info.suffix = unite(x.suffix, y.suffix);
+  info.match = anyOf(std::move(x.match), std::move(y.match));
+  simplify(info);
+  return info;
+}
+
+Info optional(Info x) {
+  if (!x.exact) {
+    return anything();
+  }
+  x.exact->insert("");
+  x.emptyable = true;
+  x.match = TrigramQuery::all();
+  return x;
+}
+
+Info repeated(Info x) {
+  makeInexact(x);
+  return x;
+}
+
+// Walks ECMAScript regex syntax and derives the Info of the whole pattern.
+// Anything it does not understand is treated as matching anything, so the
+// resulting query may admit extra candidates but never rejects a match.
+class RegexAnalyzer {
+public:
+  explicit RegexAnalyzer(std::string_view pattern)
+      : pattern_(pattern), pos_(0) {}
+
+  Info analyze() {
+    Info info = alternation();
+    while (pos_ < pattern_.size()) {
+      pos_++;
+      info = concat(std::move(info), anything());
+      info = concat(std::move(info), alternation());
+    }
+    return info;
+  }
+
+private:
+  bool atEnd() const { return pos_ >= pattern_.size(); }
+
+  Info alternation() {
+    Info info = concatenation();
+    while (!atEnd() && pattern_[pos_] == '|') {
+      pos_++;
+      info = alternate(std::move(info), concatenation());
+    }
+    return info;
+  }
+
+  Info concatenation() {
+    Info info = emptyString();
+    while (!atEnd() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+      info = concat(std::move(info), quantified(atom()));
+    }
+    return info;
+  }
+
+  Info quantified(Info info) {
+    while (!atEnd()) {
+      char c = pattern_[pos_];
+      size_t minimum = 0;
+      size_t maximum = 0;
+      if (c == '*') {
+        pos_++;
+        info = anything();
+      } else if (c == '+') {
+        pos_++;
+        info = repeated(std::move(info));
+      } else if (c == '?') {
+        pos_++;
+        info = optional(std::move(info));
+      } else if (c == '{' && bounds(minimum, maximum)) {
+        if (minimum > 0) {
+          info = repeated(std::move(info));
+        } else if (maximum == 1) {
+          info = optional(std::move(info));
+        } else {
+          info = anything();
+        }
+      } else {
+        break;
+      }
+      if (!atEnd() && pattern_[pos_] == '?') {
+        pos_++;
+      }
+    }
+    return info;
+  }
+
+  bool bounds(size_t &minimum, size_t &maximum) {
+    size_t pos = pos_ + 1;
+    auto number = [&](size_t &value) {
+      size_t start = pos;
+      value = 0;
+      while (pos < pattern_.size() && pattern_[pos] >= '0' &&
+             pattern_[pos] <= '9') {
+        value = value * 10 + static_cast<size_t>(pattern_[pos++] - '0');
+      }
+      return pos > start;
+    };
+
+    if (!number(minimum)) {
+      return false;
+    }
+    maximum = minimum;
+    if (pos < pattern_.size() && pattern_[pos] == ',') {
+      pos++;
+      if (!number(maximum)) {
+        maximum = SIZE_MAX;
+      }
+    }
+    if (pos >= pattern_.size() || pattern_[pos] != '}') {
+      return false;
+    }
+    pos_ = pos + 1;
+    return true;
+  }
+
+  Info atom() {
+    char c = pattern_[pos_++];
+    switch (c) {
+    case '(':
+      return group();
+    case '[':
+      return characterClass();
+    case '.':
+      return anyChar();
+    case '^':
+    case '$':
+      return emptyString();
+    case '\\':
+      return escape();
+    default:
+      return chars({std::string(1, fold(c))});
+    }
+  }
+
+  Info group() {
+    bool lookaround = false;
+    if (!atEnd() && pattern_[pos_] == '?') {
+      pos_++;
+      if (!atEnd() && pattern_[pos_] == '<') {
+        pos_++;
+      }
+      lookaround = !atEnd() && pattern_[pos_] != ':';
+      pos_++;
+    }
+
+    Info info = alternation();
+    if (!atEnd() && pattern_[pos_] == ')') {
+      pos_++;
+    }
+    return lookaround ? emptyString() : info;
+  }
+
+  Info characterClass() {
+    bool negated = !atEnd() && pattern_[pos_] == '^';
+    if (negated) {
+      pos_++;
+    }
+
+    StringSet set;
+    bool unbounded = false;
+    while (!atEnd() && pattern_[pos_] != ']') {
+      char low = pattern_[pos_++];
+      if (low == '\\' && !atEnd()) {
+        char escaped = pattern_[pos_++];
+        std::optional<char> single = escapedChar(escaped);
+        if (!single) {
+          unbounded = true;
+          continue;
+        }
+        low = *single;
+      }
+
+      char high = low;
+      if (pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' &&
+          pattern_[pos_ + 1] != ']') {
+        high = pattern_[pos_ + 1];
+        pos_ += 2;
+        if (high == '\\') {
+          unbounded = true;
+          continue;
+        }
+      }
+
+      if (static_cast<size_t>(static_cast<unsigned char>(high) -
+                              static_cast<unsigned char>(low)) >= MAX_CLASS) {
+        unbounded = true;
+        continue;
+      }
+      for (int value = static_cast<unsigned char>(low);
+           value <= static_cast<unsigned char>(high); ++value) {
+        set.insert(std::string(1, fold(static_cast<char>(value))));
+      }
+    }
+    if (!atEnd()) {
+      pos_++;
+    }
+
+    if (negated || unbounded || set.size() > MAX_CLASS) {
+      return anyChar();
+    }
+    return chars(std::move(set));
+  }
+
+  std::optional<char> escapedChar(char c) {
+    switch (c) {
+    case 'n':
+      return '\n';
+    case 't':
+      return '\t';
+    case 'r':
+      return '\r';
+    case 'f':
+      return '\f';
+    case 'v':
+      return '\v';
+    case '0':
+      return '\0';
+    case 'x':
+      return hexChar(2);
+    case 'u':
+      return hexChar(4);
+    case 'c':
+      // Engines disagree on what \cX matches, so it is some character.
+      if (!atEnd()) {
+        pos_++;
+      }
+      return std::nullopt;
+    default:
+      if (std::isalnum(static_cast<unsigned char>(c))) {
+        return std::nullopt;
+      }
+      return c;
+    }
+  }
+
+  // Consumes the digits of \xHH or \uHHHH. Code points outside ASCII are
+  // stored as several bytes, so they only count as some character.
+  std::optional<char> hexChar(size_t digits) {
+    if (pos_ + digits > pattern_.size()) {
+      return std::nullopt;
+    }
+    for (size_t i = 0; i < digits; ++i) {
+      if (!std::isxdigit(static_cast<unsigned char>(pattern_[pos_ + i]))) {
+        return std::nullopt;
+      }
+    }
+    unsigned long value =
+        std::stoul(std::string(pattern_.substr(pos_, digits)), nullptr, 16);
+    pos_ += digits;
+    if (value >= 0x80) {
+      return std::nullopt;
+    }
+    return static_cast<char>(value);
+  }
+
+  Info escape() {
+    if (atEnd()) {
+      return anything();
+    }
+    char c = pattern_[pos_++];
+    if (c == 'b' || c == 'B') {
+      return emptyString();
+    }
+    if (c >= '1' && c <= '9') {
+      while (!atEnd() && pattern_[pos_] >= '0' && pattern_[pos_] <= '9') {
+        pos_++;
+      }
+      return anything();
+    }
+    std::optional<char> single = escapedChar(c);
+    if (!single) {
+      return anyChar();
+    }
+    return chars({std::string(1, fold(*single))});
+  }
+
+  std::string_view pattern_;
+  size_t pos_;
+};
+
+std::string trigramText(uint32_t trigram) {
+  std::string text;
+  for (int shift : {16, 8, 0}) {
+    auto c = static_cast<unsigned char>((trigram >> shift) & 0xff);
+    if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+      text += static_cast<char>(c);
+    } else {
+      const char *digits = "0123456789abcdef";
+      text += "\\x";
+      text += digits[c >> 4];
+      text += digits[c & 0xf];
+    }
+  }
+  return text;
+}
+
+} // namespace
+
+std::vector<uint32_t> extractTrigrams(std::string_view text) {
+  std::vector<uint32_t> trigrams;
+  if (text.size() < 3) {
+    return trigrams;
+  }
+
+  trigrams.reserve(text.size() - 2);
+  for (size_t i = 0; i + 3 <= text.size(); ++i) {
+    if (text[i] == '\n' || text[i + 1] == '\n' || text[i + 2] == '\n') {
+      continue;
+    }
+    trigrams.push_back(
+        (static_cast<uint32_t>(static_cast<unsigned char>(fold(text[i])))
+         << 16) |
+        (static_cast<uint32_t>(static_cast<unsigned char>(fold(text[i + 1])))
+         << 8) |
+        static_cast<unsigned char>(fold(text[i + 2])));
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  return trigrams;
+}
+
+TrigramQuery allOf(TrigramQuery a, TrigramQuery b) {
+  using Op = TrigramQuery::Op;
+  if (a.op == Op::None || b.op == Op::None) {
+    return TrigramQuery::none();
+  }
+  if (a.op == Op::All) {
+    return b;
+  }
+  if (b.op == Op::All) {
+    return a;
+  }
+  if (a.op == Op::Or && b.op == Op::And) {
+    std::swap(a, b);
+  }
+  if (a.op == Op::And && b.op == Op::And) {
+    mergeTrigrams(a.trigrams, b.trigrams);
+    for (auto &sub : b.subs) {
+      addSub(a.subs, std::move(sub));
+    }
+    return a;
+  }
+  if (a.op == Op::And) {
+    addSub(a.subs, std::move(b));
+    return a;
+  }
+
+  TrigramQuery query;
+  query.op = Op::And;
+  query.subs.push_back(std::move(a));
+  addSub(query.subs, std::move(b));
+  return query;
+}
+
+TrigramQuery anyOf(TrigramQuery a, TrigramQuery b) {
+  using Op = TrigramQuery::Op;
+  if (a.op == Op::All || b.op == Op::All) {
+    return TrigramQuery::all();
+  }
+  if (a.op == Op::None) {
+    return b;
+  }
+  if (b.op == Op::None) {
+    return a;
+  }
+  if (a.op == Op::And && b.op == Op::Or) {
+    std::swap(a, b);
+  }
+  if (a.op == Op::Or && b.op == Op::Or) {
+    mergeTrigrams(a.trigrams, b.trigrams);
+    for (auto &sub : b.subs) {
+      addSub(a.subs, std::move(sub));
+    }
+    return a;
+  }
+  if (a.op == Op::Or) {
+    if (isSingle(b)) {
+      mergeTrigrams(a.trigrams, b.trigrams);
+    } else {
+      addSub(a.subs, std::move(b));
+    }
+    return a;
+  }
+
+  TrigramQuery query;
+  query.op = Op::Or;
+  for (auto *side : {&a, &b}) {
+    if (isSingle(*side)) {
+      mergeTrigrams(query.trigrams, side->trigrams);
+    } else {
+      addSub(query.subs, std::move(*side));
+    }
+  }
+  return query;
+}
+
+TrigramQuery TrigramQuery::fromRegex(std::string_view pattern) {
+  Info info = RegexAnalyzer(pattern).analyze();
+  if (info.exact) {
+    return allOf(std::move(info.match), anyString(*info.exact));
+  }
+  return std::move(info.match);
+}
+
+std::string TrigramQuery::toString() const {
+  if (op == Op::All) {
+    return "ALL";
+  }
+  if (op == Op::None) {
+    return "NONE";
+  }
+
+  std::vector<std::string> terms;
+  for (uint32_t trigram : trigrams) {
+    std::string term = "\"";
+    term += trigramText(trigram);
+    term += '"';
+    terms.push_back(std::move(term));
+  }
+  for (const auto &sub : subs) {
+    terms.push_back(sub.toString());
+  }
+
+  std::string text;
+  for (const auto &term : terms) {
+    if (!text.empty()) {
+      text += op == Op::And ? " AND " : " OR ";
+    }
+    text += term;
+  }
+  return terms.size() > 1 ? "(" + text + ")" : text;
+}
+
+} // namespace glint
@@ -0,0 +1,141 @@
+#include "glint/trigram.h"
+#include <algorithm>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << "\n";
+    failures++;
+  }
+}
+
+// Whether a file whose content has these trigrams is a regex candidate.
+bool admits(const glint::TrigramQuery &query,
+            const std::vector<uint32_t> &trigrams) {
+  using Op = glint::TrigramQuery::Op;
+  auto has = [&](uint32_t trigram) {
+    return std::binary_search(trigrams.begin(), trigrams.end(), trigram);
+  };
+
+  switch (query.op) {
+  case Op::All:
+    return true;
+  case Op::None:
+    return false;
+  case Op::And:
+    return std::all_of(query.trigrams.begin(), query.trigrams.end(), has) &&
+           std::all_of(query.subs.begin(), query.subs.end(),
+                       [&](const auto &sub) { return admits(sub, trigrams); });
+  case Op::Or:
+    return std::any_of(query.trigrams.begin(), query.trigrams.end(), has) ||
+           std::any_of(query.subs.begin(), query.subs.end(),
+                       [&](const auto &sub) { return admits(sub, trigrams); });
+  }
+  return false;
+}
+
+// The plan may admit extra files but must never reject a matching one.
+// Texts the engine may or may not match are only checked against the plan.
+void checkCandidate(const std::string &pattern, const std::string &text) {
+  auto query = glint::TrigramQuery::fromRegex(pattern);
+  check(admits(query, glint::extractTrigrams(text)),
+        "/" + pattern + "/ rejects \"" + text + "\" with plan " +
+            query.toString());
+}
+
+void checkAdmits(const std::string &pattern, const std::string &text) {
+  check(std::regex_search(text, std::regex(pattern, std::regex::icase)),
+        "test text does not match /" + pattern + "/");
+  checkCandidate(pattern, text);
+}
+
+void checkRejects(const std::string &pattern, const std::string &text) {
+  auto query = glint::TrigramQuery::fromRegex(pattern);
+  check(!admits(query, glint::extractTrigrams(text)),
+        "/" + pattern + "/ admits \"" + text + "\" with plan " +
+            query.toString());
+}
+
+void checkPlan(const std::string &pattern, const std::string &plan) {
+  std::string actual = glint::TrigramQuery::fromRegex(pattern).toString();
+  check(actual == plan,
+        "/" + pattern + "/ planned " + actual + ", expected " + plan);
+}
+
+void testPlans() {
+  checkPlan("ab", "ALL");
+  checkPlan("abc", "\"abc\"");
+  checkPlan("abcd", "(\"abc\" AND \"bcd\")");
+  checkPlan("ABC", "\"abc\"");
+  checkPlan("abc|xyz", "(\"abc\" OR \"xyz\")");
+  checkPlan(".*", "ALL");
+  checkPlan("a.c", "ALL");
+  checkPlan("\\d+", "ALL");
+}
+
+void testLiterals() {
+  checkAdmits("needle", "a needle in a haystack");
+  checkAdmits("Needle", "a NEEDLE in a haystack");
+  checkAdmits("foo\\.bar", "call foo.bar()");
+  checkAdmits("a\\tb\\tc", "a\tb\tc");
+  checkRejects("needle", "a haystack");
+  checkRejects("foo\\.bar", "call foo_bar()");
+}
+
+void testOperators() {
+  checkAdmits("colou?r", "color");
+  checkAdmits("colou?r", "colour");
+  checkAdmits("ab+c", "abbbbc");
+  checkAdmits("ab*c", "ac");
+  checkAdmits("ab{0,2}cd", "acd");
+  checkAdmits("ab{2,}cd", "abbbcd");
+  checkAdmits("(foo|bar)baz", "barbaz");
+  checkAdmits("(?:foo|bar)baz", "foobaz");
+  checkAdmits("foo(?=bar)", "foobar");
+  checkAdmits("foo(?!bar)", "foobaz");
+  checkAdmits("^start", "start of line");
+  checkAdmits("end$", "the end");
+  checkAdmits("\\bword\\b", "a word here");
+  checkAdmits("(ab)\\1", "abab");
+  checkAdmits("[Hh]ello", "hello");
+  checkAdmits("[a-c]xyz", "bxyz");
+  checkAdmits("[^a]xyz", "bxyz");
+  checkAdmits("x[0-9]+y", "x42y");
+  checkRejects("(foo|bar)baz", "quxbaz");
+}
+
+void testEscapes() {
+  checkAdmits("nothing\\u0020to", "nothing to see");
+  checkAdmits("nothing\\x20to", "nothing to see");
+  checkCandidate("caf\\u00e9s", "caf\xc3\xa9s");
+  checkCandidate("caf\\u00e9s", "caf\xe9s");
+  checkCandidate("tab\\cIstop", "tab\tstop");
+  checkCandidate("tab\\cIstop", "tabIstop");
+  checkAdmits("[\\u0041-\\u0043]bc", "Bbc");
+  checkAdmits("a\\sb", "a b");
+  checkAdmits("\\w+@\\w+\\.com", "mail me@example.com");
+  checkRejects("nothing\\u0020to", "nothingto");
+}
+
+} // namespace
+
+int main() {
+  testPlans();
+  testLiterals();
+  testOperators();
+  testEscapes();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "All trigram checks passed\n";
+  return 0;
+}